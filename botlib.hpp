@@ -0,0 +1,461 @@
+#pragma once
+#ifndef ZARUWORKS_BOTLIB_HPP
+#define ZARUWORKS_BOTLIB_HPP
+
+// header-only SDK for bots talking to the fighting harness over stdin/stdout.
+// every buffer is allocated once, so a turn never touches the heap.
+
+#include "hoolib.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+
+#ifndef BOTLIB_MAX_SOLDIERS
+#define BOTLIB_MAX_SOLDIERS 1024
+#endif
+
+namespace BotLib {
+
+enum {
+    FIELD_WIDTH = 7, FIELD_HEIGHT = 7,
+    SELF_ZONE_HEIGHT = 2,
+    MAX_SOLDIERS = BOTLIB_MAX_SOLDIERS,
+};
+
+// protocol versions. the harness offers DELTA with a "PROTOCOL <n>" line
+// after it has read the arrangement, and the bot answers with the version it accepts.
+// a DELTA turn starts with "F <checksum>" followed by the full lists,
+// or "D <checksum>" followed by changed soldiers and removed ids of each side.
+// a bot whose checksum disagrees answers -1 instead of its moves to request a full frame.
+enum {
+    PROTOCOL_PLAIN = 1, PROTOCOL_DELTA = 2,
+    DELTA_RESYNC_INTERVAL = 16,
+};
+
+// order-independent hash summed over every soldier both sides know of
+inline std::uint32_t statusHash(int id, int y, int x, int hp, int kind)
+{
+    std::uint32_t h = id;
+    h = h * 0x9e3779b1u ^ y;
+    h = h * 0x9e3779b1u ^ x;
+    h = h * 0x9e3779b1u ^ hp;
+    h = h * 0x9e3779b1u ^ kind;
+    return h ^ (h >> 15);
+}
+
+// the checksum goes over the wire as a non-negative int
+inline int wireChecksum(std::uint32_t sum) { return static_cast<int>(sum & 0x7fffffff); }
+
+enum KIND { KNIGHT = 0, FIGHTER, ASSASSIN };
+
+struct Status
+{
+    int id, x, y, hp, kind;
+};
+
+struct Move
+{
+    int id;
+    char dir;   // one of 'L', 'U', 'R', 'D'
+};
+
+using Arrangement = HooLib::multi_array<int, FIELD_WIDTH * SELF_ZONE_HEIGHT, 3>;
+
+// std::vector-like array whose storage lives inside the object
+template<class T, std::size_t Capacity>
+class FixedArray
+{
+private:
+    T data_[Capacity];
+    std::size_t size_;
+
+public:
+    FixedArray()
+        : size_(0)
+    {}
+
+    static constexpr std::size_t capacity() { return Capacity; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void clear() { size_ = 0; }
+    void pop() { size_--; }
+
+    T& push()
+    {
+        HOOLIB_THROW_UNLESS(size_ < Capacity, "FixedArray is full.");
+        return data_[size_++];
+    }
+
+    T& operator[](std::size_t i) { return data_[i]; }
+    const T& operator[](std::size_t i) const { return data_[i]; }
+
+    T *begin() { return data_; }
+    T *end() { return data_ + size_; }
+    const T *begin() const { return data_; }
+    const T *end() const { return data_ + size_; }
+};
+
+// buffered reader on a raw file descriptor
+class Reader
+{
+private:
+    int fd_;
+    std::size_t pos_, size_;
+    char buf_[1 << 16];
+
+private:
+    bool fill()
+    {
+        ssize_t n;
+        do{
+            n = ::read(fd_, buf_, sizeof(buf_));
+        }while(n < 0 && errno == EINTR);
+        pos_ = 0;
+        size_ = n > 0 ? n : 0;
+        return size_ != 0;
+    }
+
+public:
+    Reader(int fd = 0)
+        : fd_(fd), pos_(0), size_(0)
+    {}
+
+    // returns false on EOF
+    bool skipSpace()
+    {
+        for(;;){
+            if(pos_ == size_ && !fill())    return false;
+            char ch = buf_[pos_];
+            if(ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r')  return true;
+            pos_++;
+        }
+    }
+
+    // returns the next non-space character without consuming it, or 0 on EOF
+    char peek()
+    {
+        return skipSpace() ? buf_[pos_] : 0;
+    }
+
+    // skips the next whitespace-delimited word
+    bool skipWord()
+    {
+        if(!skipSpace())    return false;
+        for(;;){
+            if(pos_ == size_ && !fill())    return true;
+            char ch = buf_[pos_];
+            if(ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')  return true;
+            pos_++;
+        }
+    }
+
+    bool readInt(int& out)
+    {
+        if(!skipSpace())    return false;
+        bool isMinus = false;
+        if(buf_[pos_] == '-'){
+            isMinus = true;
+            pos_++;
+        }
+        int res = 0, digits = 0;
+        for(;;){
+            if(pos_ == size_ && !fill())    break;
+            char ch = buf_[pos_];
+            if(ch < '0' || '9' < ch)    break;
+            res = res * 10 + (ch - '0');
+            digits++;
+            pos_++;
+        }
+        HOOLIB_THROW_UNLESS(digits != 0, "not number");
+        out = isMinus ? -res : res;
+        return true;
+    }
+};
+
+// buffered writer on a raw file descriptor; nothing is sent until flush()
+class Writer
+{
+private:
+    int fd_;
+    std::size_t size_;
+    char buf_[1 << 16];
+
+public:
+    Writer(int fd = 1)
+        : fd_(fd), size_(0)
+    {}
+
+    ~Writer()
+    {
+        flush();
+    }
+
+    void flush()
+    {
+        std::size_t done = 0;
+        while(done < size_){
+            ssize_t n = ::write(fd_, buf_ + done, size_ - done);
+            if(n < 0 && errno == EINTR) continue;
+            HOOLIB_THROW_UNLESS(n > 0, "output pipe doesn't work correctly.");
+            done += n;
+        }
+        size_ = 0;
+    }
+
+    void putChar(char ch)
+    {
+        if(size_ == sizeof(buf_))   flush();
+        buf_[size_++] = ch;
+    }
+
+    void putInt(int n)
+    {
+        char tmp[12];
+        int len = 0;
+        unsigned int u = n < 0 ? -static_cast<unsigned int>(n) : n;
+        do{
+            tmp[len++] = '0' + u % 10;
+            u /= 10;
+        }while(u != 0);
+        if(n < 0)   putChar('-');
+        while(len != 0)   putChar(tmp[--len]);
+    }
+};
+
+struct NoState {};
+
+// one bot session. keep it alive for the whole match (e.g. as a static)
+// and store whatever should survive between turns in State.
+template<class State = NoState>
+class Bot
+{
+public:
+    using StatusList = FixedArray<Status, MAX_SOLDIERS>;
+
+private:
+    Reader in_;
+    Writer out_;
+    StatusList self_, enemy_;
+    FixedArray<Move, MAX_SOLDIERS> moves_;
+    int turn_;
+    int protocol_, maxProtocol_;
+    std::uint32_t checksum_;
+    int slot_[2][MAX_SOLDIERS * 2];   // id -> index in self_/enemy_, or -1
+    State state_;
+
+private:
+    StatusList& list(int side) { return side == 0 ? self_ : enemy_; }
+
+    int& slot(int side, int id)
+    {
+        HOOLIB_THROW_UNLESS(0 <= id && id < MAX_SOLDIERS * 2, "invalid id.");
+        return slot_[side][id];
+    }
+
+    bool readStatus(Status& st)
+    {
+        return in_.readInt(st.id) && in_.readInt(st.y) && in_.readInt(st.x) && in_.readInt(st.hp) && in_.readInt(st.kind);
+    }
+
+    bool readSize(int& size)
+    {
+        if(!in_.readInt(size))  return false;
+        HOOLIB_THROW_UNLESS(0 <= size && size <= MAX_SOLDIERS, "too many soldiers.");
+        return true;
+    }
+
+    bool readStatusList(StatusList& dst)
+    {
+        int size;
+        if(!readSize(size)) return false;
+        dst.clear();
+        for(int i = 0;i < size;i++)
+            HOOLIB_THROW_UNLESS(readStatus(dst.push()), "input pipe doesn't work correctly.");
+        return true;
+    }
+
+    void clearSide(int side)
+    {
+        for(auto&& st : list(side))
+            slot_[side][st.id] = -1;
+        list(side).clear();
+    }
+
+    void upsert(int side, const Status& st)
+    {
+        auto& src = list(side);
+        int& s = slot(side, st.id);
+        if(s < 0){
+            s = src.size();
+            src.push() = st;
+        }
+        else{
+            auto& old = src[s];
+            checksum_ -= statusHash(old.id, old.y, old.x, old.hp, old.kind);
+            old = st;
+        }
+        checksum_ += statusHash(st.id, st.y, st.x, st.hp, st.kind);
+    }
+
+    void remove(int side, int id)
+    {
+        auto& src = list(side);
+        int& s = slot(side, id);
+        HOOLIB_THROW_IF(s < 0, "removed id is unknown.");
+        auto& old = src[s];
+        checksum_ -= statusHash(old.id, old.y, old.x, old.hp, old.kind);
+        auto& last = src[src.size() - 1];
+        slot_[side][last.id] = s;
+        old = last;
+        src.pop();
+        s = -1;
+    }
+
+    void readFullSide(int side)
+    {
+        int size;
+        HOOLIB_THROW_UNLESS(readSize(size), "input pipe doesn't work correctly.");
+        clearSide(side);
+        for(int i = 0;i < size;i++){
+            Status st;
+            HOOLIB_THROW_UNLESS(readStatus(st), "input pipe doesn't work correctly.");
+            upsert(side, st);
+        }
+    }
+
+    void readDeltaSide(int side)
+    {
+        int size;
+        HOOLIB_THROW_UNLESS(readSize(size), "input pipe doesn't work correctly.");
+        for(int i = 0;i < size;i++){
+            Status st;
+            HOOLIB_THROW_UNLESS(readStatus(st), "input pipe doesn't work correctly.");
+            upsert(side, st);
+        }
+        HOOLIB_THROW_UNLESS(readSize(size), "input pipe doesn't work correctly.");
+        for(int i = 0;i < size;i++){
+            int id;
+            HOOLIB_THROW_UNLESS(in_.readInt(id), "input pipe doesn't work correctly.");
+            remove(side, id);
+        }
+    }
+
+    void answerProtocol()
+    {
+        int offered;
+        HOOLIB_THROW_UNLESS(in_.skipWord() && in_.readInt(offered), "input pipe doesn't work correctly.");
+        protocol_ = HooLib::min(offered, maxProtocol_);
+        out_.putInt(protocol_);
+        out_.putChar('\n');
+        out_.flush();
+    }
+
+    // reads one DELTA frame; returns false if the checksum doesn't match
+    bool readFrame()
+    {
+        char kind = in_.peek();
+        int checksum;
+        HOOLIB_THROW_UNLESS((kind == 'F' || kind == 'D') && in_.skipWord() && in_.readInt(checksum), "invalid frame.");
+        if(kind == 'F'){
+            checksum_ = 0;
+            readFullSide(0);
+            readFullSide(1);
+        }
+        else{
+            readDeltaSide(0);
+            readDeltaSide(1);
+        }
+        return wireChecksum(checksum_) == checksum;
+    }
+
+public:
+    Bot()
+        : turn_(-1), protocol_(PROTOCOL_PLAIN), maxProtocol_(PROTOCOL_DELTA), checksum_(0), state_()
+    {
+        for(auto&& side : slot_)
+            for(auto&& s : side)
+                s = -1;
+    }
+
+    // highest protocol version to accept when the harness offers one
+    void setMaxProtocol(int version) { maxProtocol_ = version; }
+    int protocol() const { return protocol_; }
+
+    State& state() { return state_; }
+    const State& state() const { return state_; }
+    int turn() const { return turn_; }
+
+    const StatusList& self() const { return self_; }
+    const StatusList& enemy() const { return enemy_; }
+
+    void sendArrangement(const Arrangement& src)
+    {
+        for(int i = 0;i < SELF_ZONE_HEIGHT;i++){
+            for(int j = 0;j < FIELD_WIDTH * 3;j++){
+                if(j != 0)  out_.putChar(' ');
+                out_.putInt(src[i * FIELD_WIDTH + j / 3][j % 3]);
+            }
+            out_.putChar('\n');
+        }
+        out_.flush();
+    }
+
+    // reads the next turn in place. returns false when the harness has finished.
+    bool readTurn()
+    {
+        moves_.clear();
+        if(in_.peek() == 'P')   answerProtocol();
+        if(protocol_ == PROTOCOL_PLAIN){
+            if(!readStatusList(self_))  return false;
+            HOOLIB_THROW_UNLESS(readStatusList(enemy_), "input pipe doesn't work correctly.");
+        }
+        else{
+            if(in_.peek() == 0) return false;
+            if(!readFrame()){
+                // out of sync; ask for a full frame
+                out_.putInt(-1);
+                out_.putChar('\n');
+                out_.flush();
+                HOOLIB_THROW_UNLESS(in_.peek() == 'F' && readFrame(), "resync failed.");
+            }
+        }
+        turn_++;
+        return true;
+    }
+
+    void move(int id, char dir)
+    {
+        auto& moi = moves_.push();
+        moi.id = id;
+        moi.dir = dir;
+    }
+
+    void endTurn()
+    {
+        out_.putInt(moves_.size());
+        out_.putChar('\n');
+        for(auto&& moi : moves_){
+            out_.putInt(moi.id);
+            out_.putChar(' ');
+            out_.putChar(moi.dir);
+            out_.putChar('\n');
+        }
+        out_.flush();
+    }
+};
+
+// sends the arrangement, then calls think(bot) once per turn until the harness closes the pipe
+template<class State, class Think>
+void run(Bot<State>& bot, const Arrangement& arrangement, Think think)
+{
+    bot.sendArrangement(arrangement);
+    while(bot.readTurn()){
+        think(bot);
+        bot.endTurn();
+    }
+}
+
+}
+
+#endif
@@ -2,6 +2,8 @@
 #ifndef ZARUWORKS_HOOLIB_HPP
 #define ZARUWORKS_HOOLIB_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <array>
 #include <memory>
@@ -82,7 +84,7 @@ inline std::string to_str(T t)
     return ss.str();
 }
 
-int str2int(const std::string& str)
+inline int str2int(const std::string& str)
 {
     HOOLIB_THROW_UNLESS(!str.empty(), "str is empty.");
 
@@ -101,14 +103,14 @@ int str2int(const std::string& str)
 
 
 // min <= x < sup
-int randomInt(int min, int sup)
+inline int randomInt(int min, int sup)
 {
     static std::mt19937 engine = std::mt19937(std::random_device()());
     std::uniform_int_distribution<> dist(min, sup - 1);
     return dist(engine);
 }
 
-double randomFloat(double min, double sup)
+inline double randomFloat(double min, double sup)
 {
     static std::mt19937 engine = std::mt19937(std::random_device()());
     std::uniform_real_distribution<> dist(min, sup);
@@ -138,9 +140,9 @@ public:
     static RGB sora()  { return RGB( 88, 178, 220); }
     static RGB momo()  { return RGB(245, 150, 170); }
 };
-template<> double RGB::r<double>() const { return divd(r_, 0xff); }
-template<> double RGB::g<double>() const { return divd(g_, 0xff); }
-template<> double RGB::b<double>() const { return divd(b_, 0xff); }
+template<> inline double RGB::r<double>() const { return divd(r_, 0xff); }
+template<> inline double RGB::g<double>() const { return divd(g_, 0xff); }
+template<> inline double RGB::b<double>() const { return divd(b_, 0xff); }
 
 class Vec2d
 {
@@ -203,9 +205,101 @@ struct multi_array_type<T, Size>
 template<typename T, std::size_t Size, std::size_t ...Sizes>
 using multi_array = typename multi_array_type<T, Size, Sizes...>::type;
 
+// monotonic arena. deallocation is a no-op and reset() rewinds everything at once.
+// chunks are kept across resets, so once warmed up it stops calling the global allocator.
+class MonotonicArena
+{
+private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+
+    std::vector<Chunk> chunks_;
+    std::size_t current_, offset_, nextChunkSize_;
+    std::size_t allocationCount_, upstreamCount_;
+
+public:
+    MonotonicArena(std::size_t initialChunkSize = 1 << 16)
+        : current_(0), offset_(0), nextChunkSize_(initialChunkSize), allocationCount_(0), upstreamCount_(0)
+    {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    void *allocate(std::size_t size, std::size_t align)
+    {
+        allocationCount_++;
+        for(;;){
+            if(current_ < chunks_.size()){
+                auto& chunk = chunks_[current_];
+                auto base = reinterpret_cast<std::uintptr_t>(chunk.data.get());
+                std::size_t offset = ((base + offset_ + align - 1) & ~static_cast<std::uintptr_t>(align - 1)) - base;
+                if(offset + size <= chunk.size){
+                    offset_ = offset + size;
+                    return chunk.data.get() + offset;
+                }
+                current_++;
+                offset_ = 0;
+                continue;
+            }
+
+            std::size_t chunkSize = max(nextChunkSize_, size + align);
+            chunks_.push_back(Chunk{std::unique_ptr<char[]>(new char[chunkSize]), chunkSize});
+            nextChunkSize_ = chunkSize * 2;
+            upstreamCount_++;
+        }
+    }
+
+    // invalidates everything allocated so far and clears the counters
+    void reset()
+    {
+        current_ = offset_ = 0;
+        allocationCount_ = upstreamCount_ = 0;
+    }
+
+    // allocations served since the last reset()
+    std::size_t getAllocationCount() const { return allocationCount_; }
+    // chunks taken from the global allocator since the last reset()
+    std::size_t getUpstreamCount() const { return upstreamCount_; }
+};
+
+template<class T>
+class ArenaAllocator
+{
+    template<class U> friend class ArenaAllocator;
+
+private:
+    MonotonicArena *arena_;
+
+public:
+    using value_type = T;
+
+    ArenaAllocator(MonotonicArena& arena)
+        : arena_(&arena)
+    {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& rhs)
+        : arena_(rhs.arena_)
+    {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, std::size_t) {}
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U>& rhs) const { return arena_ == rhs.arena_; }
+    template<class U>
+    bool operator!=(const ArenaAllocator<U>& rhs) const { return arena_ != rhs.arena_; }
+};
+
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
 //
 
-std::vector<std::string> splitStrByChars(const std::string& src, const std::string& delimChars)
+inline std::vector<std::string> splitStrByChars(const std::string& src, const std::string& delimChars)
 {
     std::shared_ptr<char> data(new char[src.size() + 1], std::default_delete<char[]>());
     std::vector<std::string> ret;
@@ -1,25 +1,58 @@
 #include "hoolib.hpp"
+#include "botlib.hpp"   // for the turn protocol shared with bots
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <vector>
 
-// for animation gif
-//#include <boost/format.hpp>
-//#include "SvgDrawer.hpp"
-//#include <sstream>
+// for match records (rendered offline by render.cpp)
+#include <fstream>
+
+// for the match server
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // for PopenPlayer
 #include <boost/process.hpp>
+#include <boost/process/extend.hpp>
+#include <fcntl.h>
+#include <poll.h>
 namespace bp = boost::process;
 
+// count calls to the global allocator so that per-turn allocations can be reported
+#include <atomic>
+#include <cstdlib>
+#include <new>
+std::atomic<std::size_t> globalAllocCount(0);
+void *operator new(std::size_t size)
+{
+    globalAllocCount++;
+    if(void *p = std::malloc(size != 0 ? size : 1))    return p;
+    throw std::bad_alloc();
+}
+// not inlined: gcc would otherwise see free() on memory from new at every delete and warn
+__attribute__((noinline)) void operator delete(void *p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
 enum {
     FIELD_WIDTH = 7, FIELD_HEIGHT = 7,
     SELF_ZONE_HEIGHT = 2,
+    CELL_NUM = FIELD_WIDTH * FIELD_HEIGHT,
 };
 
 enum class DIRECTION { LEFT, UP, RIGHT, DOWN };
+const char DIRECTION_CHARS[] = "LURD";  // indexed by DIRECTION
 
 class Pos
 {
@@ -60,6 +93,84 @@ public:
     }
 };
 
+// precomputed masks for BitBoard
+struct BitBoardTable
+{
+    std::uint64_t attackRange[CELL_NUM];    // cells within distance 2 (13-cell diamond)
+    std::uint64_t movable[4];               // cells from which a move in DIRECTION stays on the board
+};
+
+constexpr BitBoardTable buildBitBoardTable()
+{
+    BitBoardTable t = {};
+    for(int y = 0;y < FIELD_HEIGHT;y++){
+        for(int x = 0;x < FIELD_WIDTH;x++){
+            int index = x + y * FIELD_WIDTH;
+            for(int dy = -2;dy <= 2;dy++)
+                for(int dx = -2;dx <= 2;dx++)
+                    if((dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy) <= 2 &&
+                        0 <= x + dx && x + dx < FIELD_WIDTH && 0 <= y + dy && y + dy < FIELD_HEIGHT)
+                        t.attackRange[index] |= std::uint64_t(1) << (index + dx + dy * FIELD_WIDTH);
+
+            bool legal[4] = {x > 0, y > 0, x < FIELD_WIDTH - 1, y < FIELD_HEIGHT - 1};  // LEFT, UP, RIGHT, DOWN
+            for(int dir = 0;dir < 4;dir++)
+                if(legal[dir])  t.movable[dir] |= std::uint64_t(1) << index;
+        }
+    }
+    return t;
+}
+
+constexpr BitBoardTable BITBOARD_TABLE = buildBitBoardTable();
+
+// occupancy of the board, one 64-bit mask per owner and kind.
+// bit i stands for the cell whose Pos::getIndex() is i.
+class BitBoard
+{
+public:
+    using Mask = std::uint64_t;
+
+private:
+    HooLib::multi_array<Mask, 2, 3> occupancy_;
+
+public:
+    BitBoard()
+        : occupancy_()
+    {}
+
+    static Mask bit(int index) { return Mask(1) << index; }
+    static int popcount(Mask mask) { return __builtin_popcountll(mask); }
+    static int lowestIndex(Mask mask) { return __builtin_ctzll(mask); }
+
+    static Mask attackRange(int index) { return BITBOARD_TABLE.attackRange[index]; }
+    static Mask movable(DIRECTION dir) { return BITBOARD_TABLE.movable[static_cast<int>(dir)]; }
+
+    // moves every cell in mask one step; cells falling off the board must be masked out beforehand
+    static Mask shift(Mask mask, DIRECTION dir)
+    {
+        switch(dir)
+        {
+        case DIRECTION::LEFT:   return mask >> 1;
+        case DIRECTION::UP:     return mask >> FIELD_WIDTH;
+        case DIRECTION::RIGHT:  return mask << 1;
+        case DIRECTION::DOWN:   return mask << FIELD_WIDTH;
+        }
+        return 0;
+    }
+
+    void set(int owner, int kind, int index) { occupancy_[owner][kind] |= bit(index); }
+
+    Mask get(int owner, int kind) const { return occupancy_[owner][kind]; }
+    Mask get(int owner) const { return occupancy_[owner][0] | occupancy_[owner][1] | occupancy_[owner][2]; }
+
+    // number of cells within attack range of index that hold a soldier of the other owner
+    int countEnemyCellsInRange(int owner, int index) const { return popcount(attackRange(index) & get(owner == 0 ? 1 : 0)); }
+    bool anyEnemyInRange(int owner, int index) const { return (attackRange(index) & get(owner == 0 ? 1 : 0)) != 0; }
+
+    // cells that owner's soldiers can move from in dir, and where they end up
+    Mask legalSources(int owner, DIRECTION dir) const { return get(owner) & movable(dir); }
+    Mask legalDestinations(int owner, DIRECTION dir) const { return shift(legalSources(owner, dir), dir); }
+};
+
 class Soldier;
 using SoldierPtr = std::shared_ptr<Soldier>;
 using SoldierPtrList = std::vector<SoldierPtr>;
@@ -95,6 +206,7 @@ private:
 public:
     virtual ~Soldier(){}
 
+    static SoldierPtr create(const Status& status) { return createSoldierPtr(status); }
     static SoldierPtr createKnight(int id, int owner, const Pos& pos) { return createSoldierPtr(Status(KIND::KNIGHT, 200, id, owner, pos)); }
     static SoldierPtr createFighter(int id, int owner, const Pos& pos) { return createSoldierPtr(Status(KIND::FIGHTER, 200, id, owner, pos)); }
     static SoldierPtr createAssassin(int id, int owner, const Pos& pos) { return createSoldierPtr(Status(KIND::ASSASSIN, 200, id, owner, pos)); }
@@ -174,7 +286,85 @@ struct MoveInstruction
         : id(aid), dir(adir)
     {}
 };
-using MoveInstructionList = std::vector<MoveInstruction>;
+// threads kept across calls of run(), so that dispatching work every turn
+// neither creates threads nor allocates
+class WorkerGroup
+{
+private:
+    std::mutex mtx_;
+    std::condition_variable start_, done_;
+    std::vector<std::thread> threads_;
+    void (*job_)(void *, int);
+    void *context_;
+    unsigned long generation_;
+    int pending_;
+    bool quit_;
+
+private:
+    void work(int t)
+    {
+        unsigned long seen = 0;
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                start_.wait(lock, [&] { return quit_ || generation_ != seen; });
+                if(quit_)   return;
+                seen = generation_;
+            }
+            job_(context_, t);
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(--pending_ == 0) done_.notify_one();
+        }
+    }
+
+public:
+    WorkerGroup(int threadNum)
+        : job_(nullptr), context_(nullptr), generation_(0), pending_(0), quit_(false)
+    {
+        for(int t = 1;t < threadNum;t++)
+            threads_.emplace_back([this, t] { work(t); });
+    }
+
+    ~WorkerGroup()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            quit_ = true;
+        }
+        start_.notify_all();
+        for(auto&& th : threads_)
+            th.join();
+    }
+
+    WorkerGroup(const WorkerGroup&) = delete;
+    WorkerGroup& operator=(const WorkerGroup&) = delete;
+
+    // including the calling thread
+    int size() const { return threads_.size() + 1; }
+
+    // calls fn(t) for every t in [0, size()), t == 0 on the calling thread, and returns when all have finished
+    template<class Fn>
+    void run(Fn& fn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            job_ = [](void *context, int t) { (*static_cast<Fn *>(context))(t); };
+            context_ = &fn;
+            pending_ = threads_.size();
+            generation_++;
+        }
+        start_.notify_all();
+        fn(0);
+        std::unique_lock<std::mutex> lock(mtx_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+    }
+};
+
+// turn-scoped containers; they live in the Stage's turn arena
+template<class T>
+using TurnVector = HooLib::ArenaVector<T>;
+using MoveInstructionList = TurnVector<MoveInstruction>;
+using StatusList = TurnVector<Soldier::Status>;
 
 class Stage
 {
@@ -182,42 +372,179 @@ public:
     struct BiasedStatus
     {
         int selfOwnerId;
-        std::vector<Soldier::Status> self, enemy;
+        StatusList self, enemy;
+
+        BiasedStatus(HooLib::MonotonicArena& arena)
+            : self(arena), enemy(arena)
+        {}
     };
 
 private:
     SoldierPtrColony soldiers_;
+    std::vector<Soldier *> idIndex_;
+    int turn_;
+    int updateThreadNum_;
+    std::unique_ptr<WorkerGroup> updateWorkers_;    // null while updating on one thread
+    HooLib::MonotonicArena turnArena_;
+
+    // below this many battles a turn is cheaper on one thread than waking the workers
+    enum { PARALLEL_UPDATE_MIN_BATTLES = 256 };
+
+private:
+    Stage(const SoldierPtrList& src, std::vector<Soldier *> idIndex, int turn)
+        : soldiers_(src), idIndex_(std::move(idIndex)), turn_(turn), updateThreadNum_(1)
+    {}
+
+    static void indexSoldier(std::vector<Soldier *>& idIndex, Soldier *soldier)
+    {
+        int id = soldier->getStatus().id;
+        HOOLIB_THROW_UNLESS(id >= 0, "id is invalid.");
+        if(idIndex.size() <= static_cast<std::size_t>(id))  idIndex.resize(id + 1, nullptr);
+        idIndex[id] = soldier;
+    }
+
+    static void putInt(std::ostream& os, std::uint32_t n, int bytes)
+    {
+        for(int i = 0;i < bytes;i++)
+            os.put(static_cast<char>(n >> (i * 8) & 0xff));
+    }
+
+    static std::uint32_t getInt(std::istream& is, int bytes)
+    {
+        std::uint32_t n = 0;
+        for(int i = 0;i < bytes;i++){
+            int ch = is.get();
+            HOOLIB_THROW_UNLESS(ch != std::istream::traits_type::eof(), "snapshot is truncated.");
+            n |= static_cast<std::uint32_t>(ch) << (i * 8);
+        }
+        return n;
+    }
 
 public:
-    Stage(const SoldierPtrList& src)
-        : soldiers_(src)
+    Stage(const SoldierPtrList& src, int turn = 0)
+        : soldiers_(src), turn_(turn), updateThreadNum_(1)
     {
+        for(auto&& solptr : soldiers_.get())
+            indexSoldier(idIndex_, solptr.get());
     }
 
     ~Stage(){}
 
+    // number of update()s since the beginning of the match
+    int getTurn() const { return turn_; }
+
+    // threads update() resolves battles on. the result doesn't depend on it.
+    // the threads are started here and kept until the next call or the end of the stage.
+    void setUpdateThreadNum(int threadNum)
+    {
+        updateThreadNum_ = HooLib::max(1, threadNum);
+        updateWorkers_.reset();
+        if(updateThreadNum_ > 1)
+            updateWorkers_.reset(new WorkerGroup(updateThreadNum_));
+    }
+    int getUpdateThreadNum() const { return updateThreadNum_; }
+
+    // compact binary snapshot, all integers little-endian:
+    //   "FSNP" version(1) turn(4) n(4), then n times id(4) kind(1) owner(1) hp(4) cell index(1),
+    //   then m(1) and m times length(4) bytes of opaque player state (version 2 only)
+    // dead soldiers are included so that a restored stage is identical.
+    void saveSnapshot(std::ostream& os, const std::vector<std::string>& playerStates = {}) const
+    {
+        auto& src = soldiers_.get();
+        os.write("FSNP", 4);
+        putInt(os, 2, 1);
+        putInt(os, turn_, 4);
+        putInt(os, src.size(), 4);
+        for(auto&& solptr : src){
+            auto& st = solptr->getStatus();
+            putInt(os, st.id, 4);
+            putInt(os, static_cast<int>(st.kind), 1);
+            putInt(os, st.owner, 1);
+            putInt(os, st.hp, 4);
+            putInt(os, st.pos.getIndex(), 1);
+        }
+        putInt(os, playerStates.size(), 1);
+        for(auto&& state : playerStates){
+            putInt(os, state.size(), 4);
+            os.write(state.data(), state.size());
+        }
+    }
+
+    // rebuilds a stage and its id index in one pass over the snapshot.
+    // the player states are stored into playerStates if given.
+    static std::shared_ptr<Stage> restoreSnapshot(std::istream& is, std::vector<std::string> *playerStates = nullptr)
+    {
+        char magic[4];
+        HOOLIB_THROW_UNLESS(is.read(magic, 4) && std::equal(magic, magic + 4, "FSNP"), "not a snapshot.");
+        int version = getInt(is, 1);
+        HOOLIB_THROW_UNLESS(version == 1 || version == 2, "unknown snapshot version.");
+        int turn = getInt(is, 4), n = getInt(is, 4);
+        HOOLIB_THROW_UNLESS(turn >= 0 && n >= 0, "snapshot is broken.");
+
+        // lengths come from the file, so nothing is allocated ahead of the bytes that are actually there
+        const int reserveLimit = 4096;
+        SoldierPtrList src;
+        std::vector<Soldier *> idIndex;
+        src.reserve(HooLib::min(n, reserveLimit));
+        for(int i = 0;i < n;i++){
+            int id = getInt(is, 4), kind = getInt(is, 1), owner = getInt(is, 1), hp = getInt(is, 4), index = getInt(is, 1);
+            HOOLIB_THROW_UNLESS(0 <= kind && kind < 3 && 0 <= owner && owner < 2 && 0 <= index && index < CELL_NUM, "snapshot is broken.");
+            src.push_back(Soldier::create(Soldier::Status(static_cast<Soldier::KIND>(kind), hp, id, owner, Pos(index))));
+            indexSoldier(idIndex, src.back().get());
+        }
+
+        std::vector<std::string> states(version >= 2 ? getInt(is, 1) : 0);
+        for(auto&& state : states){
+            char buf[reserveLimit];
+            for(std::uint32_t left = getInt(is, 4);left > 0;){
+                std::uint32_t len = HooLib::min(left, static_cast<std::uint32_t>(sizeof(buf)));
+                HOOLIB_THROW_UNLESS(is.read(buf, len), "snapshot is truncated.");
+                state.append(buf, len);
+                left -= len;
+            }
+        }
+        if(playerStates)
+            *playerStates = std::move(states);
+
+        // the constructor is private, hence no make_shared
+        return std::shared_ptr<Stage>(new Stage(src, std::move(idIndex), turn));
+    }
+
+    // everything turn-scoped is allocated here. reset it at the beginning of each turn.
+    HooLib::MonotonicArena& getTurnArena() { return turnArena_; }
+
     BiasedStatus getBiasedStatus(int selfOwnerId)
     {
-        auto self = soldiers_.byOwner(selfOwnerId).byAlive(), enemy = soldiers_.byOwner(selfOwnerId == 0 ? 1 : 0).byAlive();
-        BiasedStatus ret;
-        for(auto&& solptr : self.get())
-            ret.self.push_back(solptr->getStatus());
-        for(auto&& solptr : enemy.get())
-            ret.enemy.push_back(solptr->getStatus());
+        auto& src = soldiers_.get();
+        BiasedStatus ret(turnArena_);
+        ret.selfOwnerId = selfOwnerId;
+        ret.self.reserve(src.size());
+        ret.enemy.reserve(src.size());
+        for(auto&& solptr : src){
+            if(solptr->isDead())    continue;
+            auto& st = solptr->getStatus();
+            (st.owner == selfOwnerId ? ret.self : ret.enemy).push_back(st);
+        }
         return ret;
     }
 
     void dump(std::ostream& os = std::cout) const
     {
+        HooLib::multi_array<int, FIELD_HEIGHT, FIELD_WIDTH, 3, 2> count = {};
+        for(auto&& solptr : soldiers_.get()){
+            if(solptr->isDead())    continue;
+            auto& st = solptr->getStatus();
+            count[st.pos.getY()][st.pos.getX()][static_cast<int>(st.kind)][st.owner]++;
+        }
+
         for(int y = 0;y < FIELD_HEIGHT;y++){
             for(int kind = 0;kind < 3;kind++){
                 for(int x = 0;x < FIELD_WIDTH;x++){
-                    auto solptrs = soldiers_.byPos(Pos(x, y)).byAlive();
                     os << std::setw(2) << std::setfill('0')
-                        << solptrs.byOwner(0).byKind(static_cast<Soldier::KIND>(kind)).get().size()
+                        << count[y][x][kind][0]
                         << " ";
                     os << std::setw(2) << std::setfill('0')
-                        << solptrs.byOwner(1).byKind(static_cast<Soldier::KIND>(kind)).get().size()
+                        << count[y][x][kind][1]
                         << "  ";
                 }
                 os << std::endl;
@@ -228,15 +555,51 @@ public:
         auto& src = soldiers_.get();
         std::cout << "id kind owner hp x y" << std::endl;
         for(int i = 0;i < src.size();i++){
-            auto st = src[i]->getStatus();
+            auto& st = src[i]->getStatus();
             std::cout << st.id << " " << static_cast<int>(st.kind) << " " << st.owner << " " << st.hp << " " << st.pos.getX() << " " << st.pos.getY() << std::endl;
         }
     }
 
-    void move(const MoveInstructionList& moiList)
+    // writes "soldiers <turn> <n>" and the same lines as a frame, dead soldiers included.
+    // a record starts with it so that replaying a resumed match knows the dead as well.
+    void recordSoldiers(std::ostream& os) const
+    {
+        auto& src = soldiers_.get();
+        os << "soldiers " << turn_ << " " << src.size() << "\n";
+        for(auto&& solptr : src){
+            auto& st = solptr->getStatus();
+            os << st.id << " " << static_cast<int>(st.kind) << " " << st.owner << " " << st.hp << " " << st.pos.getX() << " " << st.pos.getY() << "\n";
+        }
+    }
+
+    // writes one frame of a match record: "frame <turn> <n>" and n lines of "id kind owner hp x y"
+    void record(std::ostream& os, int turn) const
+    {
+        auto& src = soldiers_.get();
+        int n = std::count_if(HOOLIB_RANGE(src), [](const SoldierPtr& solptr) { return solptr->isAlive(); });
+        os << "frame " << turn << " " << n << "\n";
+        for(auto&& solptr : src){
+            if(solptr->isDead())    continue;
+            auto& st = solptr->getStatus();
+            os << st.id << " " << static_cast<int>(st.kind) << " " << st.owner << " " << st.hp << " " << st.pos.getX() << " " << st.pos.getY() << "\n";
+        }
+    }
+
+    // writes "moves <turn> <n>" and n lines of "id direction" to a match record
+    template<class MoveList>
+    void recordMoves(std::ostream& os, const MoveList& moiList) const
+    {
+        os << "moves " << turn_ << " " << moiList.size() << "\n";
+        for(auto&& moi : moiList)
+            os << moi.id << " " << DIRECTION_CHARS[static_cast<int>(moi.dir)] << "\n";
+    }
+
+    template<class MoveList>
+    void move(const MoveList& moiList)
     {
         for(auto&& moi : moiList){
-            auto& soldier = *soldiers_.getFromId(moi.id);
+            HOOLIB_THROW_UNLESS(0 <= moi.id && moi.id < static_cast<int>(idIndex_.size()) && idIndex_[moi.id], "id is invalid.");
+            auto& soldier = *idIndex_[moi.id];
             auto pos = soldier.getStatus().pos.getMoved(moi.dir);
             HOOLIB_THROW_UNLESS(pos.isValid(), "pos is invalid.");
             soldier.moveTo(pos);
@@ -245,47 +608,114 @@ public:
 
     void update()
     {
-        static HooLib::multi_array<int, 13, 2> dxdyTable = {
-                          +0,-2,
-                   -1,-1, +0,-1, +1,-1,
-            -2,+0, -1,+0, +0,+0, +1,+0, +2,+0,
-                   -1,+1, +0,+1, +1,+1,
-                          +0,+2
+        // alive soldiers bucketed by owner and cell;
+        // cells[owner][i] is [begin[owner][i], begin[owner][i + 1]) in cells
+        auto& src = soldiers_.get();
+        BitBoard board;
+        HooLib::multi_array<int, 2, CELL_NUM + 1> begin = {};
+        for(auto&& solptr : src){
+            if(solptr->isDead())    continue;
+            auto& st = solptr->getStatus();
+            board.set(st.owner, static_cast<int>(st.kind), st.pos.getIndex());
+            begin[st.owner][st.pos.getIndex() + 1]++;
+        }
+        for(int owner = 0;owner < 2;owner++)
+            for(int i = 0;i < CELL_NUM;i++)
+                begin[owner][i + 1] += begin[owner][i];
+        TurnVector<Soldier *> cells[2] = {
+            TurnVector<Soldier *>(begin[0][CELL_NUM], nullptr, turnArena_),
+            TurnVector<Soldier *>(begin[1][CELL_NUM], nullptr, turnArena_)
         };
+        {
+            auto fill = begin;
+            for(auto&& solptr : src)
+                if(solptr->isAlive())
+                    cells[solptr->getStatus().owner][fill[solptr->getStatus().owner][solptr->getStatus().pos.getIndex()]++] = solptr.get();
+        }
+
+        // k only depends on where the attacker stands, so compute it once per occupied cell
+        HooLib::multi_array<int, 2, CELL_NUM> kTable = {};
+        for(int owner = 0;owner < 2;owner++){
+            int enemy = owner == 0 ? 1 : 0;
+            for(auto atkCells = board.get(owner);atkCells != 0;atkCells &= atkCells - 1){
+                int i = BitBoard::lowestIndex(atkCells);
+                if(!board.anyEnemyInRange(owner, i))    continue;
+                for(auto targets = BitBoard::attackRange(i) & board.get(enemy);targets != 0;targets &= targets - 1){
+                    int j = BitBoard::lowestIndex(targets);
+                    kTable[owner][i] += HooLib::min(10, begin[enemy][j + 1] - begin[enemy][j]);
+                }
+            }
+        }
 
         struct Battle
         {
-            SoldierPtr attacker;
-            SoldierPtrList targetAll;
+            Soldier *attacker;
             int k;
         };
 
-        std::vector<Battle> battles;
+        // gather every battle before any damage is dealt
+        TurnVector<Battle> battles(turnArena_);
+        battles.reserve(begin[0][CELL_NUM] + begin[1][CELL_NUM]);
         for(int owner = 0;owner < 2;owner++){
-            auto attackers = soldiers_.byOwner(owner).byAlive().get();
-            for(auto&& attacker : attackers){
-                Battle battle;
-                battle.attacker = attacker;
-                battle.k = 0;
-                Pos atkPos = attacker->getStatus().pos;
-
-                for(auto&& dxdy : dxdyTable){
-                    auto targetPos = Pos(atkPos.getX() + dxdy[0], atkPos.getY() + dxdy[1]);
-                    if(!targetPos.isValid()) continue;
-                    auto targetSolPtrs = soldiers_.byOwner(owner == 0 ? 1 : 0).byPos(targetPos).byAlive();
-                    if(targetSolPtrs.get().empty())   continue;
-                    battle.k += HooLib::min(10, targetSolPtrs.get().size());
-                    battle.targetAll.insert(battle.targetAll.end(), HOOLIB_RANGE(targetSolPtrs.get()));
+            for(auto&& attacker : cells[owner]){
+                int k = kTable[owner][attacker->getStatus().pos.getIndex()];
+                if(k == 0)  continue;
+                battles.push_back(Battle{attacker, k});
+            }
+        }
+        if(!updateWorkers_ || battles.size() < PARALLEL_UPDATE_MIN_BATTLES){
+            for(auto&& battle : battles){
+                auto& atkStatus = battle.attacker->getStatus();
+                int enemy = atkStatus.owner == 0 ? 1 : 0;
+                int perKind[3];
+                for(int kind = 0;kind < 3;kind++)
+                    perKind[kind] = getDamage(atkStatus.kind, static_cast<Soldier::KIND>(kind)) / battle.k;
+                for(auto targets = BitBoard::attackRange(atkStatus.pos.getIndex()) & board.get(enemy);targets != 0;targets &= targets - 1){
+                    int i = BitBoard::lowestIndex(targets);
+                    for(int j = begin[enemy][i];j < begin[enemy][i + 1];j++){
+                        auto target = cells[enemy][j];
+                        target->setHP(target->getStatus().hp - perKind[static_cast<int>(target->getStatus().kind)]);
+                    }
                 }
-                battles.push_back(battle);
             }
+            turn_++;
+            return;
         }
-        for(auto&& battle : battles){
-            for(auto& target: battle.targetAll){
-                auto hp = target->getStatus().hp;
-                target->setHP(hp - getDamage(battle.attacker->getStatus().kind, target->getStatus().kind) / battle.k);
+
+        // attackers are split into one contiguous part per worker. each thread adds its damage
+        // into its own buffer, indexed by cells[0] followed by cells[1], and the buffers are
+        // summed in thread order. integer sums don't depend on order, so this equals the serial path.
+        int threadNum = updateWorkers_->size();
+        int slotNum = begin[0][CELL_NUM] + begin[1][CELL_NUM];
+        TurnVector<int> damage(static_cast<std::size_t>(slotNum) * threadNum, 0, turnArena_);
+        auto work = [&](int t) {
+            int *dst = damage.data() + static_cast<std::size_t>(slotNum) * t;
+            std::size_t first = battles.size() * t / threadNum, last = battles.size() * (t + 1) / threadNum;
+            for(std::size_t b = first;b < last;b++){
+                auto& battle = battles[b];
+                auto& atkStatus = battle.attacker->getStatus();
+                int enemy = atkStatus.owner == 0 ? 1 : 0, base = enemy == 0 ? 0 : begin[0][CELL_NUM];
+                int perKind[3];
+                for(int kind = 0;kind < 3;kind++)
+                    perKind[kind] = getDamage(atkStatus.kind, static_cast<Soldier::KIND>(kind)) / battle.k;
+                for(auto targets = BitBoard::attackRange(atkStatus.pos.getIndex()) & board.get(enemy);targets != 0;targets &= targets - 1){
+                    int i = BitBoard::lowestIndex(targets);
+                    for(int j = begin[enemy][i];j < begin[enemy][i + 1];j++)
+                        dst[base + j] += perKind[static_cast<int>(cells[enemy][j]->getStatus().kind)];
+                }
             }
+        };
+        updateWorkers_->run(work);
+
+        for(int s = 0;s < slotNum;s++){
+            int sum = 0;
+            for(int t = 0;t < threadNum;t++)
+                sum += damage[static_cast<std::size_t>(slotNum) * t + s];
+            if(sum == 0)    continue;
+            auto target = s < begin[0][CELL_NUM] ? cells[0][s] : cells[1][s - begin[0][CELL_NUM]];
+            target->setHP(target->getStatus().hp - sum);
         }
+        turn_++;
     }
 };
 
@@ -296,26 +726,222 @@ public:
     virtual ~Player(){}
 
     virtual HooLib::multi_array<int, FIELD_WIDTH * SELF_ZONE_HEIGHT, 3> buildInitialArrangement() = 0;
-    virtual std::vector<MoveInstruction> think(const std::vector<Soldier::Status>& self, const std::vector<Soldier::Status>& enemy) = 0;
+    // appends this turn's moves to moiList
+    virtual void think(const StatusList& self, const StatusList& enemy, MoveInstructionList& moiList) = 0;
+
+    // what a snapshot needs to resume the player, e.g. its random engine. empty if there is nothing.
+    // a bot process can't be saved; it is started anew and only sees the restored stage.
+    virtual std::string saveState() const { return ""; }
+    virtual void restoreState(const std::string&) {}
 };
 
 class PopenPlayer : public Player
 {
+private:
+    struct SentStatus
+    {
+        bool alive;
+        int y, x, hp, kind, frame;
+    };
+
 private:
     bp::opstream opipe_;
     bp::ipstream ipipe_;
     std::shared_ptr<bp::child> proc_;
     HooLib::multi_array<int, FIELD_WIDTH * SELF_ZONE_HEIGHT, 3> initialArrangement_;
 
+    // for PROTOCOL_DELTA: what the bot has been told so far, indexed by id
+    int protocol_, frame_, lastFullFrame_;
+    std::uint32_t checksum_;
+    std::vector<SentStatus> sent_[2];
+    std::vector<const Soldier::Status *> changed_[2];
+    std::vector<int> removed_[2];
+
+    std::string input_;   // reused so that reading a turn doesn't allocate
+
+    // a bot that doesn't answer within this is given up on, so that it can't hold a server worker forever
+    enum { READ_TIMEOUT_MS = 10000 };
+
+private:
+    // boost creates pipes without O_CLOEXEC. spawning one bot at a time keeps a bot forked by
+    // another thread from catching the child ends of a bot that is starting; the child ends are
+    // closed in the parent before the mutex is released.
+    static std::mutex& spawnMutex()
+    {
+        static std::mutex mtx;
+        return mtx;
+    }
+
+    // runs in the forked child: everything but stdin, stdout and stderr is closed when the bot
+    // is exec'd, so no bot keeps the harness's pipes to another bot open. only async-signal-safe
+    // calls here. boost's pipe reporting exec errors is close-on-exec already and keeps working.
+    static void closeInheritedOnExec(long openMax)
+    {
+        if(::close_range(3, ~0u, CLOSE_RANGE_CLOEXEC) == 0)    return;
+        for(int fd = 3;fd < openMax;fd++){
+            int flags = ::fcntl(fd, F_GETFD);
+            if(flags >= 0)  ::fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+        }
+    }
+
+    // one line from the bot, failing with what if the pipe is broken
+    void readLine(std::string& line, const char *what)
+    {
+        if(ipipe_.rdbuf()->in_avail() <= 0){
+            pollfd pfd = {ipipe_.pipe().native_source(), POLLIN, 0};
+            int ret;
+            while((ret = ::poll(&pfd, 1, READ_TIMEOUT_MS)) < 0 && errno == EINTR);
+            HOOLIB_THROW_IF(ret == 0, "bot didn't answer in time.");
+        }
+        HOOLIB_THROW_UNLESS(ipipe_ && std::getline(ipipe_, line) && !line.empty(), what);
+    }
+
+    void writeStatus(const Soldier::Status& st)
+    {
+        opipe_
+            << st.id << " "
+            << st.pos.getY() << " "
+            << st.pos.getX() << " "
+            << st.hp << " "
+            << static_cast<int>(st.kind) << "\n";
+    }
+
+    void writeStatusList(const StatusList& list)
+    {
+        opipe_ << list.size() << "\n";
+        for(auto&& st : list)
+            writeStatus(st);
+    }
+
+    // updates sent_ to list and collects the difference into changed_ and removed_
+    void diffSide(int side, const StatusList& list)
+    {
+        auto& sent = sent_[side];
+        changed_[side].clear();
+        removed_[side].clear();
+        for(auto&& st : list){
+            if(sent.size() <= static_cast<std::size_t>(st.id))
+                sent.resize(st.id + 1, SentStatus{false, 0, 0, 0, 0, -1});
+            auto& old = sent[st.id];
+            SentStatus cur = {true, st.pos.getY(), st.pos.getX(), st.hp, static_cast<int>(st.kind), frame_};
+            if(!old.alive || old.y != cur.y || old.x != cur.x || old.hp != cur.hp || old.kind != cur.kind){
+                if(old.alive)
+                    checksum_ -= BotLib::statusHash(st.id, old.y, old.x, old.hp, old.kind);
+                checksum_ += BotLib::statusHash(st.id, cur.y, cur.x, cur.hp, cur.kind);
+                changed_[side].push_back(&st);
+            }
+            old = cur;
+        }
+        for(int id = 0;id < static_cast<int>(sent.size());id++){
+            auto& old = sent[id];
+            if(!old.alive || old.frame == frame_)   continue;
+            checksum_ -= BotLib::statusHash(id, old.y, old.x, old.hp, old.kind);
+            old.alive = false;
+            removed_[side].push_back(id);
+        }
+    }
+
+    void writeDeltaFrame(const StatusList& self, const StatusList& enemy)
+    {
+        frame_++;
+        diffSide(0, self);
+        diffSide(1, enemy);
+        if(frame_ - lastFullFrame_ >= BotLib::DELTA_RESYNC_INTERVAL){
+            writeFullFrame(self, enemy);
+            return;
+        }
+        opipe_ << "D " << BotLib::wireChecksum(checksum_) << "\n";
+        for(int side = 0;side < 2;side++){
+            opipe_ << changed_[side].size() << "\n";
+            for(auto&& st : changed_[side])
+                writeStatus(*st);
+            opipe_ << removed_[side].size() << "\n";
+            for(auto&& id : removed_[side])
+                opipe_ << id << "\n";
+        }
+    }
+
+    // sent_ must already describe self and enemy
+    void writeFullFrame(const StatusList& self, const StatusList& enemy)
+    {
+        lastFullFrame_ = frame_;
+        opipe_ << "F " << BotLib::wireChecksum(checksum_) << "\n";
+        writeStatusList(self);
+        writeStatusList(enemy);
+    }
+
+    int readMoveCount()
+    {
+        readLine(input_, "input pipe doesn't work correctly.(1)");
+        return HooLib::str2int(input_);
+    }
+
+    // parses "<id> <direction>" in place
+    MoveInstruction parseMove(const std::string& src)
+    {
+        const char *p = src.c_str(), *delim = " \t";
+        p += std::strspn(p, delim);
+        HOOLIB_THROW_UNLESS(*p != '\0', "tokens are nothing.");
+        bool isMinus = *p == '-';
+        if(isMinus) p++;
+        HOOLIB_THROW_UNLESS('0' <= *p && *p <= '9', "not number");
+        int id = 0;
+        for(;'0' <= *p && *p <= '9';p++)
+            id = id * 10 + (*p - '0');
+        HOOLIB_THROW_UNLESS(*p == '\0' || std::strchr(delim, *p), "not number");
+        p += std::strspn(p, delim);
+        HOOLIB_THROW_UNLESS(*p != '\0', "tokens' size is invalid.");
+        char dirch = *p;
+        p += std::strcspn(p, delim);
+        p += std::strspn(p, delim);
+        HOOLIB_THROW_UNLESS(*p == '\0', "tokens' size is invalid.");
+
+        DIRECTION dir;
+        switch(dirch){
+        case 'L': case 'l':
+            dir = DIRECTION::LEFT;
+            break;
+        case 'U': case 'u':
+            dir = DIRECTION::UP;
+            break;
+        case 'R': case 'r':
+            dir = DIRECTION::RIGHT;
+            break;
+        case 'D': case 'd':
+            dir = DIRECTION::DOWN;
+            break;
+        default:
+            HOOLIB_THROW("invalid direction.");
+        }
+        return MoveInstruction(isMinus ? -id : id, dir);
+    }
+
 public:
-    PopenPlayer(const std::string& command)
+    PopenPlayer(const std::string& command, int protocol = BotLib::PROTOCOL_PLAIN)
+        : protocol_(BotLib::PROTOCOL_PLAIN), frame_(-1), lastFullFrame_(-BotLib::DELTA_RESYNC_INTERVAL), checksum_(0)
     {
-        proc_ = std::make_shared<bp::child>(command, bp::std_in < opipe_, bp::std_out > ipipe_);
+        // a child that failed to exec isn't reaped by boost. on_error is only called
+        // when the error is returned through ec, not thrown. the child exits right after
+        // reporting the error, so waiting for exactly that pid doesn't block for long.
+        std::error_code ec;
+        pid_t failedPid = -1;
+        long openMax = ::sysconf(_SC_OPEN_MAX);
+        {
+            std::lock_guard<std::mutex> lock(spawnMutex());
+            proc_ = std::make_shared<bp::child>(command, bp::std_in < opipe_, bp::std_out > ipipe_, ec,
+                bp::extend::on_exec_setup = [openMax](auto&) { closeInheritedOnExec(openMax); },
+                bp::extend::on_error = [&failedPid](auto& exec, const std::error_code&) { failedPid = exec.pid; });
+        }
+        if(ec){
+            if(failedPid > 0)
+                while(::waitpid(failedPid, nullptr, 0) < 0 && errno == EINTR);
+            HOOLIB_THROW("can't start " + command + ": " + ec.message());
+        }
 
         // read initial arrangement
         for(int i = 0;i < SELF_ZONE_HEIGHT;i++){
             std::string input;
-            HOOLIB_THROW_UNLESS(ipipe_ && std::getline(ipipe_, input) && !input.empty(), "input pipe doesn't work correctly.(3)");
+            readLine(input, "input pipe doesn't work correctly.(3)");
             auto tokens = HooLib::splitStrByChars(input, " \t");
             HOOLIB_THROW_UNLESS(tokens.size() == FIELD_WIDTH * 3, "invalid field width.");
             for(int j = 0;j < FIELD_WIDTH;j++){
@@ -325,71 +951,73 @@ public:
                 }
             }
         }
+
+        // negotiate protocol version; only bots known to understand it may be offered a newer one
+        if(protocol != BotLib::PROTOCOL_PLAIN){
+            opipe_ << "PROTOCOL " << protocol << std::endl;
+            std::string input;
+            readLine(input, "input pipe doesn't work correctly.(4)");
+            protocol_ = HooLib::str2int(input);
+            HOOLIB_THROW_UNLESS(BotLib::PROTOCOL_PLAIN <= protocol_ && protocol_ <= protocol, "invalid protocol version.");
+        }
     }
 
+    ~PopenPlayer()
+    {
+        // child::terminate() only tries to reap the bot with WNOHANG and makes wait() a no-op,
+        // which would leave a zombie per match in a long-running server. killing it directly
+        // lets wait() reap exactly this pid; running() has already reaped a bot that exited.
+        std::error_code ec;
+        if(proc_->running(ec))
+            ::kill(proc_->id(), SIGKILL);
+        proc_->wait(ec);
+    }
+
+    int getProtocol() const { return protocol_; }
 
     HooLib::multi_array<int, FIELD_WIDTH * SELF_ZONE_HEIGHT, 3> buildInitialArrangement() override
     {
         return initialArrangement_;
     }
 
-    std::vector<MoveInstruction> think(const std::vector<Soldier::Status>& self, const std::vector<Soldier::Status>& enemy) override
+    void think(const StatusList& self, const StatusList& enemy, MoveInstructionList& moiList) override
     {
         // input
-        opipe_ << self.size() << std::endl;
-        for(auto&& st: self)
-            opipe_
-                << st.id << " "
-                << st.pos.getY() << " "
-                << st.pos.getX() << " "
-                << st.hp << " "
-                << static_cast<int>(st.kind) << std::endl;
-        opipe_ << enemy.size() << std::endl;
-        for(auto&& st: enemy)
-            opipe_
-                << st.id << " "
-                << st.pos.getY() << " "
-                << st.pos.getX() << " "
-                << st.hp << " "
-                << static_cast<int>(st.kind) << std::endl;
+        if(protocol_ == BotLib::PROTOCOL_DELTA){
+            writeDeltaFrame(self, enemy);
+        }
+        else{
+            writeStatusList(self);
+            writeStatusList(enemy);
+        }
+        opipe_.flush();
 
         // output
-        std::vector<MoveInstruction> moiList;
-        std::string input;
-        HOOLIB_THROW_UNLESS(ipipe_ && std::getline(ipipe_, input) && !input.empty(), "input pipe doesn't work correctly.(1)");
-        int n = HooLib::str2int(input);
+        int n = readMoveCount();
+        if(n < 0){  // the bot lost track of the deltas
+            HOOLIB_THROW_UNLESS(protocol_ == BotLib::PROTOCOL_DELTA, "invalid number of moves.");
+            writeFullFrame(self, enemy);
+            opipe_.flush();
+            n = readMoveCount();
+            HOOLIB_THROW_UNLESS(n >= 0, "resync failed.");
+        }
         for(int i = 0;i < n;i++){
-            HOOLIB_THROW_UNLESS(ipipe_ && std::getline(ipipe_, input) && !input.empty(), "input pipe doesn't work correctly.(2)");
-            auto tokens = HooLib::splitStrByChars(input, " \t");
-            HOOLIB_THROW_UNLESS(tokens.size() == 2, "tokens' size is invalid.");
-            HOOLIB_THROW_UNLESS(!tokens[1].empty(), "tokens are nothing.");
-            int id = HooLib::str2int(tokens[0]);
-            DIRECTION dir;
-            switch(tokens[1][0]){
-            case 'L': case 'l':
-                dir = DIRECTION::LEFT;
-                break;
-            case 'U': case 'u':
-                dir = DIRECTION::UP;
-                break;
-            case 'R': case 'r':
-                dir = DIRECTION::RIGHT;
-                break;
-            case 'D': case 'd':
-                dir = DIRECTION::DOWN;
-                break;
-            }
-            moiList.emplace_back(id, dir);
+            readLine(input_, "input pipe doesn't work correctly.(2)");
+            moiList.push_back(parseMove(input_));
         }
-
-        return std::move(moiList);
     }
 };
 
 class RandomPlayer : public Player
 {
+private:
+    std::mt19937 randGen_;
+    int owner_;
+
 public:
-    RandomPlayer(){}
+    //RandomPlayer(int owner = 0) : randGen_(std::random_device()()), owner_(owner) {}
+    RandomPlayer(int owner = 0) : randGen_(::time(NULL)), owner_(owner) {}   // for MinGW
+    RandomPlayer(unsigned int seed, int owner) : randGen_(seed), owner_(owner) {}
     ~RandomPlayer(){}
 
     HooLib::multi_array<int, FIELD_WIDTH * SELF_ZONE_HEIGHT, 3> buildInitialArrangement() override
@@ -399,129 +1027,88 @@ public:
             0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0
         };
 
+        std::uniform_int_distribution<> dist(0, 13);
         for(int k = 0;k < 3;k++)
             for(int i = 0;i < 10;i++)
-                ret[HooLib::randomInt(0, 14)][k]++;
+                ret[dist(randGen_)][k]++;
 
         return std::move(ret);
     }
 
-    std::vector<MoveInstruction> think(const std::vector<Soldier::Status>& self, const std::vector<Soldier::Status>& enemy) override
+    void think(const StatusList& self, const StatusList& enemy, MoveInstructionList& moiList) override
     {
-        std::vector<MoveInstruction> moiList;
+        // legal moves of every soldier at once: sources[dir] holds the cells that can move in dir.
+        // owner 1's directions are reversed by the stage, i.e. it sees the board rotated by 180 degrees.
+        auto viewIndex = [this](const Soldier::Status& st) { return owner_ == 0 ? st.pos.getIndex() : CELL_NUM - 1 - st.pos.getIndex(); };
+        BitBoard board;
+        for(auto&& solst : self)
+            board.set(owner_, static_cast<int>(solst.kind), viewIndex(solst));
+        BitBoard::Mask sources[4];
+        for(int dir = 0;dir < 4;dir++)
+            sources[dir] = board.legalSources(owner_, static_cast<DIRECTION>(dir));
+
         for(auto&& solst : self){
-            //static auto randGen = std::mt19937(std::random_device()());
-            static auto randGen = std::mt19937(::time(NULL));   // for MinGW
-            std::array<DIRECTION, 4> dirTable = {
-                DIRECTION::LEFT, DIRECTION::UP, DIRECTION::RIGHT, DIRECTION::DOWN
-            };
-            std::shuffle(HOOLIB_RANGE(dirTable), randGen);
-            for(auto&& dir : dirTable){
-                auto pos = solst.pos.getMoved(dir);
-                if(!pos.isValid())  continue;
-                moiList.emplace_back(solst.id, dir);
-                break;
-            }
+            // pick one of the legal directions uniformly
+            int index = viewIndex(solst);
+            unsigned int dirs = 0;
+            for(int dir = 0;dir < 4;dir++)
+                dirs |= static_cast<unsigned int>(sources[dir] >> index & 1) << dir;
+            int n = std::uniform_int_distribution<>(0, BitBoard::popcount(dirs) - 1)(randGen_);
+            for(int i = 0;i < n;i++)
+                dirs &= dirs - 1;
+            moiList.emplace_back(solst.id, static_cast<DIRECTION>(BitBoard::lowestIndex(dirs)));
         }
-        return moiList;
     }
-};
 
-/*
-void drawStageStatus(const Stage::BiasedStatus& status, const std::string& filename)
-{
-    static std::array<HooLib::RGB, 3> colorTable = {
-        HooLib::RGB::red(), HooLib::RGB::green(), HooLib::RGB::blue()
-    };
-    HooLib::multi_array<int, FIELD_WIDTH, FIELD_HEIGHT, 2, 3> map = {};
-    for(auto&& soldier : status.self)
-        map[soldier.pos.getX()][soldier.pos.getY()][0][static_cast<int>(soldier.kind)]++;
-    for(auto&& soldier : status.enemy)
-        map[soldier.pos.getX()][soldier.pos.getY()][1][static_cast<int>(soldier.kind)]++;
-
-    std::vector<std::pair<HooLib::Rect, HooLib::RGB>> rects;
-    for(int y = 0;y < FIELD_HEIGHT;y++)
-        for(int x = 0;x < FIELD_WIDTH;x++)
-            for(int o = 0;o < 2;o++)
-                for(int k = 0;k < 3;k++)
-                    if(map[x][y][o][k] != 0)
-                        rects.push_back(std::make_pair(
-                            HooLib::XYWH(
-                                x * 100 + 50 * o,
-                                y * 100 + k * 33,
-                                map[x][y][o][k] * 5,
-                                33),
-                            colorTable[k]));
-
-    mi::SvgDrawer drawer(700, 700, filename);
-    drawer.setViewBox(0, 0, 700, 700);
-    for(int y = 0;y <= FIELD_HEIGHT;y++)
-        drawer.drawLine(0, y * 100, 100 * FIELD_WIDTH, y * 100);
-    for(int x = 0;x <= FIELD_WIDTH;x++)
-        drawer.drawLine(x * 100, 0, x * 100, 100 * FIELD_HEIGHT);
-    for(auto&& src : rects){
-        auto& rect = src.first;
-        auto& color = src.second;
-        auto colorStr = (boost::format("#%02x%02x%02x") % color.r() % color.g() % color.b()).str();
-        drawer.setFillColor(colorStr);
-        drawer.setStrokeColor(colorStr);
-        drawer.drawRect(rect.x(), rect.y(), rect.width() - 1, rect.height() - 1);
+    std::string saveState() const override
+    {
+        std::stringstream ss;
+        ss << randGen_;
+        return ss.str();
     }
-}
-*/
-
-int main()
-{
-    /*
-    HooLib::multi_array<int, 2, 49, 3> src = {
-    //int src[2][49][3] = {  // KNI, FIG, ASA
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0,
-        0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0, 0,0,0
-    };
 
-    for(int k = 0;k < 3;k++){
-        for(int i = 0;i < 10;i++){
-            src[0][35 + HooLib::randomInt(0, 14)][k]++;
-            src[1][HooLib::randomInt(0, 14)][k]++;
-        }
+    void restoreState(const std::string& state) override
+    {
+        // restarting from the seed would diverge from the interrupted match
+        HOOLIB_THROW_UNLESS(!state.empty(), "snapshot has no state for RandomPlayer.");
+        std::stringstream ss(state);
+        HOOLIB_THROW_UNLESS(ss >> randGen_, "RandomPlayer's state is broken.");
     }
+};
 
-    SoldierPtrList solList;
-    int id = 0;
-    for(int a = 0;a < 2;a++){
-        for(int b = 0;b < 49;b++){
-            for(int c = 0;c < 3;c++){
-                for(int i = 0;i < src[a][b][c];i++){
-                    switch(c){
-                    case 0: solList.push_back(Soldier::createKnight(id++, a, Pos(b)));  break;
-                    case 1: solList.push_back(Soldier::createFighter(id++, a, Pos(b)));  break;
-                    case 2: solList.push_back(Soldier::createAssassin(id++, a, Pos(b)));  break;
-                    }
-                }
-            }
-        }
-    }
-    */
+struct MatchConfig
+{
+    std::string commands[2];    // bot commands; "random" plays RandomPlayer
+    int protocol;               // protocol version offered to bots; only DELTA-aware bots may get more than PLAIN
+    unsigned int seed;          // seeds RandomPlayer
+    int turnLimit;
+    std::string recordPath;     // empty for no record
+    std::string restorePath;    // snapshot to resume from instead of the players' arrangements
+    std::string checkpointPath; // snapshot rewritten after every turn
+    int updateThreadNum;        // see Stage::setUpdateThreadNum
+    bool verbose;               // dump the stage and allocation counts every turn
+
+    MatchConfig()
+        : commands{"./move_forward", "./move_forward"}, protocol(BotLib::PROTOCOL_PLAIN), seed(::time(NULL)), turnLimit(100), updateThreadNum(1), verbose(false)
+    {}
+};
 
-    std::shared_ptr<Player> players[2];
-    //players[0] = std::make_shared<RandomPlayer>();
-    //players[1] = std::make_shared<RandomPlayer>();
-    players[0] = std::make_shared<PopenPlayer>("./move_forward");
-    players[1] = std::make_shared<PopenPlayer>("./move_forward");
+struct MatchResult
+{
+    int winner;     // owner with more alive soldiers, or -1 for a draw
+    int alive[2];
+    int turns;
+};
+
+std::shared_ptr<Player> createPlayer(const MatchConfig& config, int owner)
+{
+    if(config.commands[owner] == "random")
+        return std::make_shared<RandomPlayer>(config.seed + owner, owner);
+    return std::make_shared<PopenPlayer>(config.commands[owner], config.protocol);
+}
 
+SoldierPtrList buildSoldierList(std::shared_ptr<Player> players[2])
+{
     SoldierPtrList solList;
     for(int p = 0;p < 2;p++){
         auto src = players[p]->buildInitialArrangement();
@@ -545,17 +1132,65 @@ int main()
         }
     }
 
-    Stage stage(solList);
+    return solList;
+}
+
+// writes the stage to path atomically, so that an interrupted run leaves the previous checkpoint intact
+void saveCheckpoint(const Stage& stage, const std::string& path, const std::vector<std::string>& playerStates = {})
+{
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary);
+        stage.saveSnapshot(ofs, playerStates);
+        HOOLIB_THROW_UNLESS(ofs.flush(), "can't write checkpoint.");
+    }
+    HOOLIB_THROW_UNLESS(std::rename(tmpPath.c_str(), path.c_str()) == 0, "can't write checkpoint.");
+}
+
+MatchResult runMatch(std::shared_ptr<Player> players[2], const MatchConfig& config)
+{
+    std::ofstream recordStream;
+    if(!config.recordPath.empty()){
+        recordStream.open(config.recordPath);
+        HOOLIB_THROW_UNLESS(recordStream, "can't open record file.");
+        recordStream << "fighting-record 1\n";
+    }
+
+    std::shared_ptr<Stage> stagePtr;
+    if(!config.restorePath.empty()){
+        std::ifstream ifs(config.restorePath, std::ios::binary);
+        HOOLIB_THROW_UNLESS(ifs, "can't open snapshot.");
+        std::vector<std::string> playerStates;
+        stagePtr = Stage::restoreSnapshot(ifs, &playerStates);
+        for(int owner = 0;owner < 2;owner++)
+            players[owner]->restoreState(owner < static_cast<int>(playerStates.size()) ? playerStates[owner] : "");
+    }
+    else{
+        stagePtr = std::make_shared<Stage>(buildSoldierList(players));
+    }
+    auto& stage = *stagePtr;
+    stage.setUpdateThreadNum(config.updateThreadNum);
+
+    if(config.verbose)
+        stage.dump();
+    if(recordStream.is_open()){
+        stage.recordSoldiers(recordStream);
+        stage.record(recordStream, stage.getTurn());
+    }
+    while(stage.getTurn() < config.turnLimit){
+        int turn = stage.getTurn();
+        auto& arena = stage.getTurnArena();
+        arena.reset();
+        std::size_t globalAllocCount = ::globalAllocCount;
 
-    stage.dump();
-    //drawStageStatus(stage.getBiasedStatus(0), "pic/test000.svg");
-    for(int turn = 0;turn < 100;turn++){
-        std::vector<MoveInstruction> moiList;
+        MoveInstructionList moiList(arena);
         for(int owner = 0;owner < 2;owner++){
             auto status = stage.getBiasedStatus(owner);
-            auto tmp = players[owner]->think(status.self, status.enemy);
+            std::size_t first = moiList.size();
+            players[owner]->think(status.self, status.enemy, moiList);
             if(owner == 1){ // reverse direction
-                for(auto& moi : tmp){
+                for(auto it = moiList.begin() + first;it != moiList.end();++it){
+                    auto& moi = *it;
                     switch(moi.dir){
                     case DIRECTION::LEFT:  moi.dir = DIRECTION::RIGHT; break;
                     case DIRECTION::UP:    moi.dir = DIRECTION::DOWN;  break;
@@ -564,12 +1199,544 @@ int main()
                     }
                 }
             }
-            moiList.insert(moiList.end(), HOOLIB_RANGE(tmp));
         }
+        if(recordStream.is_open())
+            stage.recordMoves(recordStream, moiList);
         stage.move(moiList);
         stage.update();
-        std::cout << turn << "===" << std::endl;
-        stage.dump();
-        //drawStageStatus(stage.getBiasedStatus(0), (boost::format("pic/test%03d.svg") % (turn + 1)).str());
+        if(!config.checkpointPath.empty())
+            saveCheckpoint(stage, config.checkpointPath, {players[0]->saveState(), players[1]->saveState()});
+        if(config.verbose){
+            std::cerr << "turn " << turn << ": "
+                << arena.getAllocationCount() << " arena allocations, "
+                << arena.getUpstreamCount() << " arena chunks, "
+                << ::globalAllocCount - globalAllocCount << " global allocations" << std::endl;
+            std::cout << turn << "===" << std::endl;
+            stage.dump();
+        }
+        if(recordStream.is_open())
+            stage.record(recordStream, turn + 1);
+    }
+
+    MatchResult ret = {-1, {0, 0}, stage.getTurn()};
+    for(int owner = 0;owner < 2;owner++){
+        auto status = stage.getBiasedStatus(owner);
+        ret.alive[owner] = status.self.size();
+    }
+    if(ret.alive[0] != ret.alive[1])
+        ret.winner = ret.alive[0] > ret.alive[1] ? 0 : 1;
+    return ret;
+}
+
+// times Stage::update for growing armies on 1..maxThreadNum threads.
+// soldiers are spread uniformly over the board with enough hp to survive every turn,
+// and every parallel run is checked against the serial one.
+void benchmarkUpdate(int maxThreadNum)
+{
+    const int armySizes[] = {100, 1000, 3000, 10000};
+    const int turnNum = 5;
+
+    std::cout << "soldiers/side threads us/update speedup" << std::endl;
+    for(int armySize : armySizes){
+        std::vector<int> expected;
+        double serialUs = 0;
+        for(int threadNum = 1;threadNum <= maxThreadNum;threadNum++){
+            std::mt19937 rng(armySize);
+            SoldierPtrList src;
+            for(int owner = 0;owner < 2;owner++)
+                for(int i = 0;i < armySize;i++)
+                    src.push_back(Soldier::create(Soldier::Status(static_cast<Soldier::KIND>(rng() % 3), 1000000000, src.size(), owner, Pos(rng() % CELL_NUM))));
+            Stage stage(src);
+            stage.setUpdateThreadNum(threadNum);
+
+            auto begin = std::chrono::steady_clock::now();
+            for(int turn = 0;turn < turnNum;turn++){
+                stage.getTurnArena().reset();
+                stage.update();
+            }
+            auto end = std::chrono::steady_clock::now();
+            double us = std::chrono::duration<double, std::micro>(end - begin).count() / turnNum;
+
+            std::vector<int> hps;
+            for(auto&& solptr : src)
+                hps.push_back(solptr->getStatus().hp);
+            if(threadNum == 1){
+                expected = hps;
+                serialUs = us;
+            }
+            HOOLIB_THROW_UNLESS(hps == expected, "parallel update differs from the serial one.");
+            std::cout << armySize << " " << threadNum << " " << static_cast<long long>(us) << " " << serialUs / us << std::endl;
+        }
+    }
+}
+
+// what fast-forwarding needs from a match record: the soldiers at the start and every turn's moves
+struct MatchRecord
+{
+    SoldierPtrList initial;
+    int firstTurn;
+    std::vector<std::vector<MoveInstruction>> moves;   // moves[i] is applied on turn firstTurn + i
+};
+
+MatchRecord loadMatchRecord(const std::string& path)
+{
+    std::ifstream ifs(path);
+    HOOLIB_THROW_UNLESS(ifs, "can't open record file.");
+    std::string tag;
+    int version;
+    HOOLIB_THROW_UNLESS(ifs >> tag >> version && tag == "fighting-record" && version == 1, "not a match record.");
+
+    MatchRecord ret;
+    ret.firstTurn = -1;
+    int turn, n;
+    while(ifs >> tag >> turn >> n){
+        // records written before "soldiers" existed start from their first frame,
+        // which lacks the soldiers that were dead already
+        if((tag == "soldiers" || tag == "frame") && ret.firstTurn < 0){
+            ret.firstTurn = turn;
+            for(int i = 0;i < n;i++){
+                int id, kind, owner, hp, x, y;
+                HOOLIB_THROW_UNLESS(ifs >> id >> kind >> owner >> hp >> x >> y, "broken record.");
+                Pos pos(x, y);
+                HOOLIB_THROW_UNLESS(0 <= kind && kind < 3 && 0 <= owner && owner < 2 && pos.isValid(), "broken record.");
+                ret.initial.push_back(Soldier::create(Soldier::Status(static_cast<Soldier::KIND>(kind), hp, id, owner, pos)));
+            }
+        }
+        else if(tag == "moves"){
+            HOOLIB_THROW_UNLESS(ret.firstTurn >= 0 && turn == ret.firstTurn + static_cast<int>(ret.moves.size()), "broken record.");
+            ret.moves.emplace_back();
+            for(int i = 0;i < n;i++){
+                int id;
+                char dir;
+                HOOLIB_THROW_UNLESS(ifs >> id >> dir && std::strchr(DIRECTION_CHARS, dir), "broken record.");
+                ret.moves.back().emplace_back(id, static_cast<DIRECTION>(std::strchr(DIRECTION_CHARS, dir) - DIRECTION_CHARS));
+            }
+        }
+        else{   // later frames are implied by the moves
+            std::string line;
+            std::getline(ifs, line);
+            for(int i = 0;i < n;i++)
+                std::getline(ifs, line);
+        }
     }
+    HOOLIB_THROW_UNLESS(ret.firstTurn >= 0, "record has no frame.");
+    return ret;
+}
+
+// rebuilds the stage of a record at turn `until` by re-applying the recorded moves, without any Player.
+// throws unless the record covers that turn.
+std::shared_ptr<Stage> fastForward(const MatchRecord& record, int until)
+{
+    int lastTurn = record.firstTurn + static_cast<int>(record.moves.size());
+    HOOLIB_THROW_UNLESS(record.firstTurn <= until && until <= lastTurn,
+        "the record covers turns " + HooLib::to_str(record.firstTurn) + " to " + HooLib::to_str(lastTurn) + " only.");
+    auto stage = std::make_shared<Stage>(record.initial, record.firstTurn);
+    for(auto&& moiList : record.moves){
+        if(stage->getTurn() >= until)   break;
+        stage->getTurnArena().reset();
+        stage->move(moiList);
+        stage->update();
+    }
+    return stage;
+}
+
+// blocking queue with a fixed capacity. push() waits while it is full,
+// which is how the match server pushes back on clients.
+template<class T>
+class BoundedQueue
+{
+private:
+    std::mutex mtx_;
+    std::condition_variable notFull_, notEmpty_;
+    std::deque<T> queue_;
+    std::size_t capacity_;
+    bool closed_;
+
+public:
+    BoundedQueue(std::size_t capacity)
+        : capacity_(capacity), closed_(false)
+    {}
+
+    // returns false if the queue has been closed
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        notFull_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+        if(closed_) return false;
+        queue_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // returns false instead of waiting
+    bool tryPush(T item)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(closed_ || queue_.size() >= capacity_)   return false;
+        queue_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // returns false once the queue is closed and drained
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        notEmpty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+        if(queue_.empty())  return false;
+        item = std::move(queue_.front());
+        queue_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+};
+
+// bot processes spawned ahead of time, so that a match doesn't wait for them to start
+// and send their arrangement. a process plays exactly one match; taking one out
+// asks the background spawner for a replacement.
+// at most maxSpares processes are kept over all commands. the least recently spawned
+// is killed to make room, so a server that has seen many bot versions doesn't pile them up.
+class WarmPlayerPool
+{
+private:
+    using Key = std::pair<std::string, int>;    // command, protocol
+    using Spare = std::pair<Key, std::shared_ptr<PopenPlayer>>;
+
+    std::mutex mtx_;
+    std::deque<Spare> spares_;  // oldest first
+    std::set<Key> broken_;      // failed to start last time; not spawned ahead until a match starts one
+    std::size_t maxSpares_;
+    BoundedQueue<Key> spawnQueue_;
+    std::thread spawner_;
+
+private:
+    std::size_t countSpares(const Key& key) const
+    {
+        return std::count_if(HOOLIB_RANGE(spares_), [&key](const Spare& spare) { return spare.first == key; });
+    }
+
+    void spawn()
+    {
+        Key key;
+        while(spawnQueue_.pop(key)){
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(broken_.count(key) || countSpares(key) >= maxSpares_)    continue;
+            }
+            std::shared_ptr<PopenPlayer> player, evicted;
+            try{
+                player = std::make_shared<PopenPlayer>(key.first, key.second);
+            }
+            catch(std::exception&){
+                // reported when a match asks for it
+                std::lock_guard<std::mutex> lock(mtx_);
+                broken_.insert(key);
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if(spares_.size() >= maxSpares_){
+                    evicted = std::move(spares_.front().second);
+                    spares_.pop_front();
+                }
+                spares_.emplace_back(key, std::move(player));
+            }
+            // evicted is killed and reaped here, outside the lock
+        }
+    }
+
+public:
+    WarmPlayerPool(std::size_t maxSpares)
+        : maxSpares_(maxSpares), spawnQueue_(maxSpares * 2)
+    {
+        spawner_ = std::thread([this] { spawn(); });
+    }
+
+    ~WarmPlayerPool()
+    {
+        spawnQueue_.close();
+        spawner_.join();
+    }
+
+    std::shared_ptr<PopenPlayer> acquire(const std::string& command, int protocol)
+    {
+        Key key(command, protocol);
+        std::shared_ptr<PopenPlayer> ret;
+        bool broken;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = std::find_if(spares_.rbegin(), spares_.rend(), [&key](const Spare& spare) { return spare.first == key; });
+            if(it != spares_.rend()){
+                ret = std::move(it->second);
+                spares_.erase(std::next(it).base());
+            }
+            broken = broken_.count(key) != 0;
+        }
+        if(!ret){
+            try{
+                ret = std::make_shared<PopenPlayer>(command, protocol);
+            }
+            catch(std::exception&){
+                std::lock_guard<std::mutex> lock(mtx_);
+                broken_.insert(key);
+                throw;
+            }
+            if(broken){ // the command works again, e.g. the bot has been rebuilt
+                std::lock_guard<std::mutex> lock(mtx_);
+                broken_.erase(key);
+            }
+        }
+        spawnQueue_.tryPush(key);
+        return ret;
+    }
+};
+
+// one client of the match server. results may be sent from any worker.
+class ServerConnection
+{
+private:
+    int fd_;
+    std::mutex mtx_;
+
+public:
+    ServerConnection(int fd)
+        : fd_(fd)
+    {}
+
+    ~ServerConnection()
+    {
+        ::close(fd_);
+    }
+
+    int getFd() const { return fd_; }
+
+    // a client that went away is not an error of the server; its results are dropped
+    void send(const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::size_t done = 0;
+        while(done < line.size()){
+            ssize_t n = ::write(fd_, line.data() + done, line.size() - done);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0)  return;
+            done += n;
+        }
+    }
+};
+
+struct MatchJob
+{
+    std::shared_ptr<ServerConnection> conn;
+    std::string id;
+    MatchConfig config;
+};
+
+// a job is one line of tab-separated fields:
+//   <id> <bot0 command> <bot1 command> <seed> <turn limit> <record path or -> [<protocol>]
+// and is answered with
+//   <id> ok <winner> <alive0> <alive1> <turns>
+// or
+//   <id> error <message>
+MatchJob parseMatchJob(const std::string& line)
+{
+    auto tokens = HooLib::splitStrByChars(line, "\t");
+    HOOLIB_THROW_UNLESS(tokens.size() == 6 || tokens.size() == 7, "invalid number of fields.");
+    MatchJob job;
+    job.id = tokens[0];
+    job.config.commands[0] = tokens[1];
+    job.config.commands[1] = tokens[2];
+    job.config.seed = HooLib::str2int(tokens[3]);
+    job.config.turnLimit = HooLib::str2int(tokens[4]);
+    HOOLIB_THROW_UNLESS(job.config.turnLimit >= 0, "invalid turn limit.");
+    if(tokens[5] != "-")
+        job.config.recordPath = tokens[5];
+    job.config.protocol = tokens.size() == 7 ? HooLib::str2int(tokens[6]) : BotLib::PROTOCOL_PLAIN;
+    HOOLIB_THROW_UNLESS(BotLib::PROTOCOL_PLAIN <= job.config.protocol && job.config.protocol <= BotLib::PROTOCOL_DELTA, "unknown protocol version.");
+    return job;
+}
+
+void readMatchJobs(std::shared_ptr<ServerConnection> conn, BoundedQueue<MatchJob>& jobs)
+{
+    std::string pending;
+    char buf[4096];
+    for(;;){
+        ssize_t n = ::read(conn->getFd(), buf, sizeof(buf));
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0)  break;
+        pending.append(buf, n);
+
+        std::size_t begin = 0, end;
+        while((end = pending.find('\n', begin)) != std::string::npos){
+            std::string line = pending.substr(begin, end - begin);
+            begin = end + 1;
+            if(!line.empty() && line.back() == '\r')    line.pop_back();
+            if(line.empty())    continue;
+            try{
+                auto job = parseMatchJob(line);
+                job.conn = conn;
+                if(!jobs.push(std::move(job)))  return;    // blocks while the queue is full
+            }
+            catch(std::exception& ex){
+                conn->send(line.substr(0, line.find('\t')) + "\terror\t" + ex.what() + "\n");
+            }
+        }
+        pending.erase(0, begin);
+    }
+}
+
+sockaddr_un buildSocketAddress(const std::string& path)
+{
+    sockaddr_un addr = {};
+    HOOLIB_THROW_UNLESS(path.size() < sizeof(addr.sun_path), "socket path is too long.");
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+// listens on a Unix domain socket and runs the jobs of every client on workerNum threads
+void runMatchServer(const std::string& socketPath, int workerNum, int queueSize)
+{
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // bots spawned by workers must not inherit client sockets
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    HOOLIB_THROW_UNLESS(listenFd >= 0, "can't create socket.");
+    auto addr = buildSocketAddress(socketPath);
+    ::unlink(socketPath.c_str());
+    HOOLIB_THROW_UNLESS(::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0, "can't bind socket.");
+    HOOLIB_THROW_UNLESS(::listen(listenFd, 64) == 0, "can't listen on socket.");
+
+    BoundedQueue<MatchJob> jobs(queueSize);
+    WarmPlayerPool pool(workerNum);
+    std::vector<std::thread> workers;
+    for(int i = 0;i < workerNum;i++){
+        workers.emplace_back([&] {
+            MatchJob job;
+            while(jobs.pop(job)){
+                try{
+                    std::shared_ptr<Player> players[2];
+                    for(int owner = 0;owner < 2;owner++){
+                        if(job.config.commands[owner] == "random")
+                            players[owner] = createPlayer(job.config, owner);
+                        else
+                            players[owner] = pool.acquire(job.config.commands[owner], job.config.protocol);
+                    }
+                    auto result = runMatch(players, job.config);
+                    job.conn->send(HooLib::fok(job.id, "\tok\t",
+                        HooLib::to_str(result.winner), "\t", HooLib::to_str(result.alive[0]), "\t",
+                        HooLib::to_str(result.alive[1]), "\t", HooLib::to_str(result.turns), "\n"));
+                }
+                catch(std::exception& ex){
+                    job.conn->send(job.id + "\terror\t" + ex.what() + "\n");
+                }
+                job = MatchJob();   // drop the connection as soon as its result is sent
+            }
+        });
+    }
+
+    for(;;){
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0){
+            HOOLIB_THROW_UNLESS(errno == EINTR || errno == ECONNABORTED, "can't accept connection.");
+            continue;
+        }
+        auto conn = std::make_shared<ServerConnection>(fd);
+        std::thread(readMatchJobs, conn, std::ref(jobs)).detach();
+    }
+}
+
+// sends job lines from stdin to a match server and prints its results until all are answered
+void submitMatchJobs(const std::string& socketPath)
+{
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    HOOLIB_THROW_UNLESS(fd >= 0, "can't create socket.");
+    auto addr = buildSocketAddress(socketPath);
+    HOOLIB_THROW_UNLESS(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0, "can't connect to the server.");
+
+    // results are read concurrently, otherwise a full queue would block both sides
+    std::thread reader([fd] {
+        char buf[4096];
+        ssize_t n;
+        while((n = ::read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+            if(n > 0)   std::cout.write(buf, n).flush();
+    });
+    std::string line;
+    while(std::getline(std::cin, line)){
+        line += "\n";
+        for(std::size_t done = 0;done < line.size();){
+            ssize_t n = ::write(fd, line.data() + done, line.size() - done);
+            if(n < 0 && errno == EINTR) continue;
+            HOOLIB_THROW_UNLESS(n > 0, "can't send to the server.");
+            done += n;
+        }
+    }
+    ::shutdown(fd, SHUT_WR);
+    reader.join();
+    ::close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    MatchConfig config;
+    config.verbose = true;
+    std::string daemonPath, submitPath, replayPath;
+    int benchThreadNum = 0;
+    int workerNum = HooLib::max(1u, std::thread::hardware_concurrency()), queueSize = 256;
+    for(int i = 1;i < argc;i++){
+        std::string arg = argv[i];
+        if(arg == "--record" && i + 1 < argc)           config.recordPath = argv[++i];
+        else if(arg == "--seed" && i + 1 < argc)        config.seed = HooLib::str2int(argv[++i]);
+        else if(arg == "--turns" && i + 1 < argc)       config.turnLimit = HooLib::str2int(argv[++i]);
+        else if(arg == "--protocol" && i + 1 < argc)    config.protocol = HooLib::str2int(argv[++i]);
+        else if(arg == "--restore" && i + 1 < argc)     config.restorePath = argv[++i];
+        else if(arg == "--checkpoint" && i + 1 < argc)  config.checkpointPath = argv[++i];
+        else if(arg == "--replay" && i + 1 < argc)      replayPath = argv[++i];
+        else if(arg == "--update-threads" && i + 1 < argc)  config.updateThreadNum = HooLib::str2int(argv[++i]);
+        else if(arg == "--bench-update" && i + 1 < argc)    benchThreadNum = HooLib::str2int(argv[++i]);
+        else if(arg == "--daemon" && i + 1 < argc)      daemonPath = argv[++i];
+        else if(arg == "--workers" && i + 1 < argc)     workerNum = HooLib::max(1, HooLib::str2int(argv[++i]));
+        else if(arg == "--queue-size" && i + 1 < argc)  queueSize = HooLib::max(1, HooLib::str2int(argv[++i]));
+        else if(arg == "--submit" && i + 1 < argc)      submitPath = argv[++i];
+        else HOOLIB_THROW("unknown option: " + arg);
+    }
+    HOOLIB_THROW_UNLESS(BotLib::PROTOCOL_PLAIN <= config.protocol && config.protocol <= BotLib::PROTOCOL_DELTA, "unknown protocol version.");
+
+    if(benchThreadNum > 0){
+        benchmarkUpdate(benchThreadNum);
+        return 0;
+    }
+    if(!daemonPath.empty()){
+        runMatchServer(daemonPath, workerNum, queueSize);
+        return 0;
+    }
+    if(!submitPath.empty()){
+        submitMatchJobs(submitPath);
+        return 0;
+    }
+    if(!replayPath.empty()){
+        // fast-forward to --turns, show the stage and save it to --checkpoint if given
+        auto record = loadMatchRecord(replayPath);
+        auto begin = std::chrono::steady_clock::now();
+        auto stage = fastForward(record, config.turnLimit);
+        auto end = std::chrono::steady_clock::now();
+        std::cerr << "fast-forwarded to turn " << stage->getTurn() << " in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << " us" << std::endl;
+        stage->dump();
+        if(!config.checkpointPath.empty())
+            saveCheckpoint(*stage, config.checkpointPath);
+        return 0;
+    }
+
+    std::shared_ptr<Player> players[2];
+    for(int owner = 0;owner < 2;owner++)
+        players[owner] = createPlayer(config, owner);
+    runMatch(players, config);
 }
@@ -0,0 +1,290 @@
+// offline renderer for match records written by `main --record <file>`.
+// renders every frame of every record to SVG on all cores, and optionally
+// assembles one animated SVG per record.
+//
+// usage: render [-j threads] [-o outdir] [-a] [-d seconds] record...
+
+#include "hoolib.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum {
+    FIELD_WIDTH = 7, FIELD_HEIGHT = 7,
+    CELL_SIZE = 100,
+};
+
+// number of alive soldiers per cell, owner and kind
+using FrameCount = HooLib::multi_array<int, FIELD_WIDTH, FIELD_HEIGHT, 2, 3>;
+
+struct Record
+{
+    std::string name;
+    std::vector<FrameCount> frames;
+    std::vector<int> turns;     // turns[i] is the turn frames[i] shows
+};
+
+Record loadRecord(const std::string& path)
+{
+    std::ifstream ifs(path);
+    HOOLIB_THROW_UNLESS(ifs, "can't open " + path);
+    std::string tag;
+    int version;
+    HOOLIB_THROW_UNLESS(ifs >> tag >> version && tag == "fighting-record" && version == 1, "not a match record: " + path);
+
+    Record ret;
+    int turn, n;
+    while(ifs >> tag >> turn >> n){
+        if(tag != "frame"){ // sections this renderer doesn't know
+            std::string line;
+            std::getline(ifs, line);
+            for(int i = 0;i < n;i++)
+                std::getline(ifs, line);
+            continue;
+        }
+        HOOLIB_THROW_UNLESS(turn >= 0, "broken record: " + path);
+        ret.frames.emplace_back();    // zero-filled
+        ret.turns.push_back(turn);
+        auto& count = ret.frames.back();
+        for(int i = 0;i < n;i++){
+            int id, kind, owner, hp, x, y;
+            HOOLIB_THROW_UNLESS(ifs >> id >> kind >> owner >> hp >> x >> y, "broken record: " + path);
+            HOOLIB_THROW_UNLESS(0 <= x && x < FIELD_WIDTH && 0 <= y && y < FIELD_HEIGHT && 0 <= owner && owner < 2 && 0 <= kind && kind < 3,
+                "broken record: " + path);
+            count[x][y][owner][kind]++;
+        }
+    }
+    return ret;
+}
+
+// appends SVG markup to one string that is kept across frames
+class SvgBuilder
+{
+private:
+    std::string buf_;
+
+public:
+    void clear() { buf_.clear(); }
+    const std::string& str() const { return buf_; }
+
+    SvgBuilder& put(const char *s) { buf_ += s; return *this; }
+    SvgBuilder& put(const std::string& s) { buf_ += s; return *this; }
+
+    SvgBuilder& put(int n)
+    {
+        char tmp[16];
+        int len = std::snprintf(tmp, sizeof(tmp), "%d", n);
+        buf_.append(tmp, len);
+        return *this;
+    }
+
+    SvgBuilder& put(double d)
+    {
+        char tmp[32];
+        int len = std::snprintf(tmp, sizeof(tmp), "%g", d);
+        buf_.append(tmp, len);
+        return *this;
+    }
+
+    void begin(int width, int height)
+    {
+        put("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+            .put("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"").put(width).put("\" height=\"").put(height)
+            .put("\" viewBox=\"0 0 ").put(width).put(" ").put(height).put("\">\n")
+            .put("<rect width=\"").put(width).put("\" height=\"").put(height).put("\" fill=\"#ffffff\"/>\n");
+    }
+
+    void end() { put("</svg>\n"); }
+
+    void line(int x1, int y1, int x2, int y2)
+    {
+        put("<line x1=\"").put(x1).put("\" y1=\"").put(y1).put("\" x2=\"").put(x2).put("\" y2=\"").put(y2)
+            .put("\" stroke=\"#000000\"/>\n");
+    }
+
+    void rect(int x, int y, int w, int h, const std::string& color)
+    {
+        put("<rect x=\"").put(x).put("\" y=\"").put(y).put("\" width=\"").put(w).put("\" height=\"").put(h)
+            .put("\" fill=\"").put(color).put("\" stroke=\"").put(color).put("\"/>\n");
+    }
+};
+
+std::string toColorStr(const HooLib::RGB& color)
+{
+    char tmp[8];
+    std::snprintf(tmp, sizeof(tmp), "#%02x%02x%02x", color.r(), color.g(), color.b());
+    return tmp;
+}
+
+// draws the board without the surrounding <svg> element
+void drawFrameBody(SvgBuilder& svg, const FrameCount& count)
+{
+    static const std::string colorTable[3] = {
+        toColorStr(HooLib::RGB::red()), toColorStr(HooLib::RGB::green()), toColorStr(HooLib::RGB::blue())
+    };
+
+    for(int y = 0;y <= FIELD_HEIGHT;y++)
+        svg.line(0, y * CELL_SIZE, CELL_SIZE * FIELD_WIDTH, y * CELL_SIZE);
+    for(int x = 0;x <= FIELD_WIDTH;x++)
+        svg.line(x * CELL_SIZE, 0, x * CELL_SIZE, CELL_SIZE * FIELD_HEIGHT);
+    for(int y = 0;y < FIELD_HEIGHT;y++)
+        for(int x = 0;x < FIELD_WIDTH;x++)
+            for(int o = 0;o < 2;o++)
+                for(int k = 0;k < 3;k++)
+                    if(count[x][y][o][k] != 0)
+                        svg.rect(x * CELL_SIZE + CELL_SIZE / 2 * o, y * CELL_SIZE + k * 33, count[x][y][o][k] * 5 - 1, 33 - 1, colorTable[k]);
+}
+
+// file name of a record without directory and extension
+std::string baseName(const std::string& path)
+{
+    auto slash = path.find_last_of("/\\");
+    auto name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    auto dot = name.rfind('.');
+    if(dot != std::string::npos && dot != 0) name.erase(dot);
+    return name;
+}
+
+// output names of the records. records sharing a file name, e.g. a/match.rec and b/match.rec,
+// get "_1", "_2", ... in command line order.
+std::vector<std::string> buildOutputNames(const std::vector<std::string>& paths)
+{
+    std::map<std::string, int> count, seen;
+    for(auto&& path : paths)
+        count[baseName(path)]++;
+
+    std::vector<std::string> ret;
+    for(auto&& path : paths){
+        auto name = baseName(path);
+        if(count[name] > 1)
+            name += "_" + HooLib::to_str(++seen[name]);
+        ret.push_back(name);
+    }
+    return ret;
+}
+
+// frames are named by turn, so that a record of a resumed match starts at its first turn.
+// turn is -1 for the animation
+std::string outputPath(const std::string& outdir, const std::string& name, int turn)
+{
+    if(turn < 0)    return outdir + "/" + name + ".svg";
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%03d.svg", turn);
+    return outdir + "/" + name + suffix;
+}
+
+void writeFile(const std::string& path, const std::string& content)
+{
+    std::ofstream ofs(path, std::ios::binary);
+    HOOLIB_THROW_UNLESS(ofs && ofs.write(content.data(), content.size()), "can't write " + path);
+}
+
+// calls fn(i, builder) for every i in [0, n) on threadNum threads; each thread owns one builder
+template<class Fn>
+void parallelFor(int n, int threadNum, Fn fn)
+{
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    std::vector<std::string> errors(threadNum);
+    for(int t = 0;t < threadNum;t++){
+        threads.emplace_back([&, t]() {
+            SvgBuilder svg;
+            try{
+                for(int i;(i = next++) < n;)
+                    fn(i, svg);
+            }
+            catch(std::exception& ex){
+                errors[t] = ex.what();
+                next = n;
+            }
+        });
+    }
+    for(auto&& th : threads)
+        th.join();
+    for(auto&& err : errors)
+        HOOLIB_THROW_IF(!err.empty(), err);
+}
+
+int main(int argc, char *argv[])
+{
+    int threadNum = HooLib::max(1u, std::thread::hardware_concurrency());
+    std::string outdir = ".";
+    bool animate = false;
+    double frameSec = 0.2;
+    std::vector<std::string> paths;
+    for(int i = 1;i < argc;i++){
+        std::string arg = argv[i];
+        if(arg == "-j" && i + 1 < argc)         threadNum = HooLib::max(1, HooLib::str2int(argv[++i]));
+        else if(arg == "-o" && i + 1 < argc)    outdir = argv[++i];
+        else if(arg == "-a")                    animate = true;
+        else if(arg == "-d" && i + 1 < argc)    frameSec = std::stod(argv[++i]);
+        else if(!arg.empty() && arg[0] == '-'){
+            std::cerr << "usage: " << argv[0] << " [-j threads] [-o outdir] [-a] [-d seconds] record..." << std::endl;
+            return 1;
+        }
+        else paths.push_back(arg);
+    }
+
+    try{
+        auto names = buildOutputNames(paths);
+        std::vector<Record> records(paths.size());
+        parallelFor(paths.size(), threadNum, [&](int i, SvgBuilder&) {
+            records[i] = loadRecord(paths[i]);
+            records[i].name = names[i];
+        });
+
+        // one job per frame, plus one per record for the animation
+        std::vector<std::pair<int, int>> jobs;   // (record, frame or -1)
+        for(int r = 0;r < static_cast<int>(records.size());r++){
+            for(int f = 0;f < static_cast<int>(records[r].frames.size());f++)
+                jobs.emplace_back(r, f);
+            if(animate) jobs.emplace_back(r, -1);
+        }
+
+        // parallel jobs writing the same file would silently clobber each other,
+        // e.g. record "x" frame 1 and record "x_001"
+        std::set<std::string> outputs;
+        for(auto&& job : jobs){
+            auto& record = records[job.first];
+            auto path = outputPath(outdir, record.name, job.second < 0 ? -1 : record.turns[job.second]);
+            HOOLIB_THROW_UNLESS(outputs.insert(path).second, "two records would be written to " + path + ", rename one of them");
+        }
+
+        parallelFor(jobs.size(), threadNum, [&](int i, SvgBuilder& svg) {
+            auto& record = records[jobs[i].first];
+            int frame = jobs[i].second;
+            svg.clear();
+            svg.begin(CELL_SIZE * FIELD_WIDTH, CELL_SIZE * FIELD_HEIGHT);
+            if(frame >= 0){
+                drawFrameBody(svg, record.frames[frame]);
+                svg.end();
+                writeFile(outputPath(outdir, record.name, record.turns[frame]), svg.str());
+                return;
+            }
+
+            // each frame is shown for frameSec; the last one stays
+            for(int f = 0;f < static_cast<int>(record.frames.size());f++){
+                bool last = f + 1 == static_cast<int>(record.frames.size());
+                svg.put("<g visibility=\"hidden\"><set attributeName=\"visibility\" to=\"visible\" begin=\"")
+                    .put(f * frameSec).put("s\"");
+                if(last)    svg.put(" fill=\"freeze\"/>\n");
+                else        svg.put(" dur=\"").put(frameSec).put("s\"/>\n");
+                drawFrameBody(svg, record.frames[f]);
+                svg.put("</g>\n");
+            }
+            svg.end();
+            writeFile(outputPath(outdir, record.name, -1), svg.str());
+        });
+    }
+    catch(std::exception& ex){
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+}